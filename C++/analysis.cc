@@ -0,0 +1,337 @@
+#include "analysis.hh"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+// Addresses I may hold, inclusive.
+struct Range {
+	uint32_t Lo;
+	uint32_t Hi;
+
+	bool operator==(const Range& o) const { return Lo == o.Lo && Hi == o.Hi; }
+	bool operator!=(const Range& o) const { return !(*this == o); }
+};
+
+// Joins at one address before its I range is given up on. Loops that walk I
+// through a table would otherwise take one pass per step.
+constexpr uint8_t MaxVisits = 16;
+
+constexpr std::array<char, 3> Magic{'C', '8', 'A'};
+}  // namespace
+
+void Analysis::run(const Rom& rom, Mode mode, Quirks quirks) {
+	RomHash = rom.Hash;
+	Size    = rom.Size;
+	Variant = mode;
+	Quirk   = quirks;
+	Escapes = false;
+	Flags.assign(Chip8::MemorySize, 0);
+	Blocks.clear();
+	Stores.clear();
+	Unknown.clear();
+
+	const bool     schip = mode != Mode::Chip8;
+	const bool     xo    = mode == Mode::XOChip;
+	const uint32_t mask  = xo ? 0xFFFF : 0xFFF;
+	const uint32_t end   = Rom::Base + rom.Size;
+	const Range    any{0, mask};
+
+	const auto byte = [&](uint32_t addr) -> uint8_t {
+		addr &= mask;
+		return addr >= Rom::Base && addr < end ? rom.Data[addr - Rom::Base]
+		                                       : 0;
+	};
+	const auto word = [&](uint32_t addr) -> uint16_t {
+		return byte(addr) << 8 | byte(addr + 1);
+	};
+	const auto length = [&](uint32_t pc) -> uint32_t {
+		return xo && word(pc) == 0xF000 ? 4 : 2;
+	};
+
+	// Where control can go after the instruction at pc, as the interpreter
+	// would run it; empty for returns, EXIT and BNNN.
+	const auto successors = [&](uint32_t pc) {
+		const uint16_t        op   = word(pc);
+		const Instr           in   = Chip8::decode(op, mode, quirks);
+		const uint32_t        fall = (pc + length(pc)) & mask;
+		const uint32_t        next = (pc + 2) & mask;
+		std::vector<uint32_t> to;
+		const auto skip = [&] { to = {next, (next + length(next)) & mask}; };
+		switch (op & 0xF000) {
+			case 0x0000:
+				if (op != 0x00EE && !(schip && op == 0x00FD)) { to = {fall}; }
+				break;
+			case 0x1000: to = {in.NNN}; break;
+			case 0x2000: to = {in.NNN, next}; break;
+			case 0x3000:
+			case 0x4000:
+			case 0x9000: skip(); break;
+			case 0x5000:
+				if (xo && (in.N == 2 || in.N == 3)) {
+					to = {next};
+				} else {
+					skip();
+				}
+				break;
+			case 0xB000: break;
+			case 0xE000:
+				if (Chip8::known(op, mode)) {
+					skip();
+				} else {
+					to = {next};
+				}
+				break;
+			default: to = {fall}; break;
+		}
+		return to;
+	};
+
+	// Increments that a loop would apply forever run I off the end, at
+	// which point it could be anywhere.
+	const auto offset = [&](Range r, uint32_t lo, uint32_t hi) {
+		return r.Hi + hi > mask ? any : Range{r.Lo + lo, r.Hi + hi};
+	};
+	const uint8_t flags = quirk_flags(quirks);
+
+	// Walk every reachable instruction, carrying the range of I into each
+	// and joining ranges where paths meet, until nothing changes.
+	std::vector<Range>        entry(Chip8::MemorySize);
+	std::vector<uint8_t>      visits(Chip8::MemorySize);
+	std::map<uint32_t, Range> stores;  // By PC
+	std::vector<uint32_t>     work;
+	const auto reach = [&](uint32_t to, Range i) {
+		if (to < Rom::Base || to + 1 >= end) {
+			Escapes = true;
+			return;
+		}
+		if (visits[to] == 0) {
+			entry[to]  = i;
+			visits[to] = 1;
+			work.push_back(to);
+			return;
+		}
+		Range joined{std::min(entry[to].Lo, i.Lo),
+		             std::max(entry[to].Hi, i.Hi)};
+		if (joined == entry[to]) { return; }
+		if (++visits[to] > MaxVisits) { joined = any; }
+		entry[to] = joined;
+		work.push_back(to);
+	};
+	reach(Rom::Base, {0, 0});
+
+	while (!work.empty()) {
+		const uint32_t pc = work.back();
+		work.pop_back();
+
+		const uint16_t op = word(pc);
+		const Instr    in = Chip8::decode(op, mode, quirks);
+		Flags[pc] |= Code;
+		for (uint32_t b = 1; b != length(pc); ++b) {
+			Flags[(pc + b) & mask] |= Operand;
+		}
+
+		const auto store = [&](Range r) {
+			auto [it, fresh] = stores.emplace(pc, r);
+			if (!fresh) {
+				it->second = {std::min(it->second.Lo, r.Lo),
+				              std::max(it->second.Hi, r.Hi)};
+			}
+		};
+		Range i = entry[pc];
+		switch (op & 0xF000) {
+			case 0x5000:
+				if (xo && in.N == 2) {
+					const uint8_t span =
+					    in.X > in.Y ? in.X - in.Y : in.Y - in.X;
+					store(offset(i, 0, span));
+				}
+				break;
+			case 0xA000:
+				i = {in.NNN, in.NNN};
+				Flags[in.NNN] |= Pointer;
+				break;
+			case 0xF000:
+				switch (in.NN) {
+					case 0x00:
+						if (xo && in.X == 0) {
+							const uint16_t addr = word(pc + 2);
+							i                   = {addr, addr};
+							Flags[addr] |= Pointer;
+						}
+						break;
+					case 0x1E: i = offset(i, 0, 0xFF); break;
+					case 0x29: i = {0, 0x4F}; break;
+					case 0x30:
+						if (schip) { i = {0x50, 0xEF}; }
+						break;
+					case 0x33: store(offset(i, 0, 2)); break;
+					case 0x55:
+					case 0x65:
+						if (in.NN == 0x55) { store(offset(i, 0, in.X)); }
+						if ((flags & IncI) != 0) {
+							i = offset(i, in.X + 1, in.X + 1);
+						}
+						if ((flags & IncIX) != 0) { i = offset(i, in.X, in.X); }
+						break;
+					default: break;
+				}
+				break;
+			default: break;
+		}
+
+		// A callee may leave I anywhere by the time it returns.
+		const std::vector<uint32_t> to = successors(pc);
+		for (const uint32_t t : to) {
+			const bool returnSite = (op & 0xF000) == 0x2000 && t == to.back();
+			reach(t, returnSite ? any : i);
+		}
+	}
+
+	for (uint32_t a = Rom::Base; a < end; ++a) {
+		if ((Flags[a] & Code) != 0 && !Chip8::known(word(a), mode)) {
+			Unknown.push_back(a);
+		}
+	}
+
+	// Stores that may write code, found with a running count of code bytes.
+	std::vector<uint32_t> codeBefore(Chip8::MemorySize + 1);
+	for (uint32_t a = 0; a != Chip8::MemorySize; ++a) {
+		const bool code   = (Flags[a] & (Code | Operand)) != 0;
+		codeBefore[a + 1] = codeBefore[a] + code;
+	}
+	for (const auto& [pc, r] : stores) {
+		Stores.push_back({uint16_t(pc), uint16_t(r.Lo), uint16_t(r.Hi),
+		                  codeBefore[r.Hi + 1] != codeBefore[r.Lo]});
+		if (r != any) {
+			for (uint32_t a = r.Lo; a <= r.Hi; ++a) { Flags[a] |= Written; }
+		}
+	}
+
+	// Blocks start at the entry point and wherever a jump, call, return
+	// site or skip lands, and end at the next one or at control flow.
+	Flags[Rom::Base] |= Leader;
+	for (uint32_t a = Rom::Base; a < end; ++a) {
+		if ((Flags[a] & Code) == 0) { continue; }
+		const std::vector<uint32_t> to = successors(a);
+		if (to.size() == 1 && to[0] == ((a + length(a)) & mask)) { continue; }
+		for (const uint32_t t : to) { Flags[t] |= Leader; }
+	}
+	for (uint32_t a = Rom::Base; a < end; ++a) {
+		if ((Flags[a] & (Code | Leader)) != (Code | Leader)) { continue; }
+
+		Block                 b;
+		std::vector<uint32_t> to;
+		uint32_t              pc = a;
+		while (true) {
+			to                  = successors(pc);
+			const uint32_t fall = (pc + length(pc)) & mask;
+			if (to.size() != 1 || to[0] != fall || (Flags[fall] & Leader) ||
+			    (Flags[fall] & Code) == 0) {
+				break;
+			}
+			pc = fall;
+		}
+		b.Start    = a;
+		b.End      = (pc + length(pc)) & mask;
+		b.Computed = (word(pc) & 0xF000) == 0xB000;
+		b.Next.assign(to.begin(), to.end());
+		Blocks.push_back(std::move(b));
+	}
+}
+
+bool Analysis::safe() const {
+	const bool computed =
+	    std::any_of(Blocks.begin(), Blocks.end(),
+	                [](const Block& b) { return b.Computed; });
+	const bool hits = std::any_of(Stores.begin(), Stores.end(),
+	                              [](const Store& s) { return s.HitsCode; });
+	return !computed && !hits;
+}
+
+bool Analysis::save(const std::string& filename) const {
+	std::error_code ec;
+	fs::create_directories(fs::path(filename).parent_path(), ec);
+	std::ofstream file(filename);
+	file << std::hex;
+	file << std::string(Magic.begin(), Magic.end()) << " " << +Version << "\n";
+	file << "rom " << RomHash << " " << Size << " " << +uint8_t(Variant) << " "
+	     << +uint8_t(Quirk) << " " << Escapes << "\n";
+	for (uint32_t a = 0; a != Flags.size(); ++a) {
+		if (Flags[a] != 0) { file << "f " << a << " " << +Flags[a] << "\n"; }
+	}
+	for (const auto& b : Blocks) {
+		file << "b " << b.Start << " " << b.End << " " << b.Computed;
+		for (const uint16_t n : b.Next) { file << " " << n; }
+		file << "\n";
+	}
+	for (const auto& s : Stores) {
+		file << "s " << s.PC << " " << s.Lo << " " << s.Hi << " " << s.HitsCode
+		     << "\n";
+	}
+	for (const uint16_t u : Unknown) { file << "u " << u << "\n"; }
+	return file.good();
+}
+
+bool Analysis::load(const std::string& filename) {
+	std::ifstream file(filename);
+	std::string   magic;
+	unsigned      version = 0;
+	file >> magic >> std::hex >> version;
+	if (!file || magic != std::string(Magic.begin(), Magic.end()) ||
+	    version != Version) {
+		return false;
+	}
+
+	Flags.assign(Chip8::MemorySize, 0);
+	Blocks.clear();
+	Stores.clear();
+	Unknown.clear();
+	file.ignore(1);
+	for (std::string line; std::getline(file, line);) {
+		std::istringstream is(line);
+		std::string        tag;
+		is >> tag >> std::hex;
+		if (tag == "rom") {
+			unsigned mode   = 0;
+			unsigned quirks = 0;
+			is >> RomHash >> Size >> mode >> quirks >> Escapes;
+			Variant = static_cast<Mode>(std::min(mode, 2U));
+			Quirk   = static_cast<Quirks>(std::min(quirks, 4U));
+		} else if (tag == "f") {
+			unsigned addr  = 0;
+			unsigned flags = 0;
+			is >> addr >> flags;
+			if (addr < Flags.size()) { Flags[addr] = flags; }
+		} else if (tag == "b") {
+			Block b;
+			is >> b.Start >> b.End >> b.Computed;
+			for (uint16_t n; is >> n;) { b.Next.push_back(n); }
+			Blocks.push_back(std::move(b));
+		} else if (tag == "s") {
+			Store s;
+			is >> s.PC >> s.Lo >> s.Hi >> s.HitsCode;
+			Stores.push_back(s);
+		} else if (tag == "u") {
+			uint16_t u = 0;
+			is >> u;
+			Unknown.push_back(u);
+		}
+		if (is.bad()) { return false; }
+	}
+	return true;
+}
+
+std::string Analysis::cache_path(const std::string& romPath, uint64_t hash,
+                                 Mode mode, Quirks quirks) {
+	std::ostringstream name;
+	name << std::hex << hash << "-" << +uint8_t(mode) << "-"
+	     << +uint8_t(quirks);
+	return (fs::path(romPath).parent_path() / ".c8analysis" / name.str())
+	    .string();
+}
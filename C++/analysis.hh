@@ -0,0 +1,80 @@
+#ifndef _C8E_ANALYSIS_HH_
+#define _C8E_ANALYSIS_HH_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "chip8.hh"
+#include "rom.hh"
+
+// What can be learned about a ROM without running it. Code is followed from
+// 0x200 through jumps, calls, returns and skips, decoding each instruction
+// with Chip8::decode; whatever isn't reached is data. I is tracked as a range
+// of addresses along the way, so stores that may land on code
+// (self-modifying writes) can be flagged.
+//
+// Results depend on the mode (the instruction set) and the quirks (how
+// FX55/FX65 move I), and are cached per ROM hash next to the ROM, in
+// <dir>/.c8analysis/<hash>-<mode>-<quirks>. The cache is plain text:
+//
+//   "C8A" version
+//   rom hash size mode quirks escapes
+//   f addr flags           one per address with any flag set
+//   b start end computed next...
+//   s pc lo hi hitsCode
+//   u addr                 reachable opcode the mode doesn't have
+//
+// Numbers are hex, mode and quirks their enum values.
+struct Analysis {
+	static constexpr uint8_t Version = 1;
+
+	enum Flag : uint8_t {
+		Code    = 1 << 0,  // Starts a reachable instruction
+		Operand = 1 << 1,  // Later byte of one
+		Leader  = 1 << 2,  // Starts a basic block
+		Pointer = 1 << 3,  // Loaded into I by ANNN or F000 NNNN (sprites)
+		Written = 1 << 4,  // A store with a bounded range may land here
+	};
+
+	struct Block {
+		uint16_t              Start{};
+		uint16_t              End{};       // Past the last instruction
+		bool                  Computed{};  // Ends in BNNN, successors unknown
+		std::vector<uint16_t> Next;        // Callee first for a call
+	};
+
+	// One store instruction (FX33, FX55, XO-CHIP 5XY2) and the bytes it may
+	// write, inclusive. A store through an unknown I covers all of memory.
+	struct Store {
+		uint16_t PC{};
+		uint16_t Lo{};
+		uint16_t Hi{};
+		bool     HitsCode{};
+	};
+
+	uint64_t RomHash{};
+	uint32_t Size{};
+	Mode     Variant{};
+	Quirks   Quirk{};
+	bool     Escapes{};  // Some path runs or jumps outside the ROM
+
+	std::vector<uint8_t>  Flags;    // Per address, Chip8::MemorySize of them
+	std::vector<Block>    Blocks;   // By start address
+	std::vector<Store>    Stores;   // By PC
+	std::vector<uint16_t> Unknown;  // By address
+
+	void run(const Rom& rom, Mode mode, Quirks quirks);
+
+	// Every jump target is known and no store can reach code, so each block
+	// can be compiled once, ahead of time, and never invalidated.
+	bool safe() const;
+
+	bool save(const std::string& filename) const;
+	bool load(const std::string& filename);
+
+	// The cache file for romPath analysed with mode and quirks.
+	static std::string cache_path(const std::string& romPath, uint64_t hash,
+	                              Mode mode, Quirks quirks);
+};
+#endif
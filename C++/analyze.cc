@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "analysis.hh"
+#include "disasm.hh"
+#include "rom.hh"
+
+// Static analysis of ROMs: a listing split into basic blocks, a summary line
+// per ROM, or the control-flow graph in Graphviz dot. Results are cached next
+// to each ROM (see analysis.hh); -f redoes them.
+
+namespace {
+void usage(const char* prog) {
+	std::cerr << "usage: " << prog
+	          << " [-m chip8|schip|xochip] [-q quirks] [-f] [-s | -g] rom...\n";
+}
+
+void summary(std::ostream& os, const std::string& path, const Analysis& a) {
+	const uint32_t end  = Rom::Base + a.Size;
+	uint32_t       code = 0;
+	for (uint32_t addr = Rom::Base; addr != end; ++addr) {
+		code += (a.Flags[addr] & (Analysis::Code | Analysis::Operand)) != 0;
+	}
+	const auto computed =
+	    std::count_if(a.Blocks.begin(), a.Blocks.end(),
+	                  [](const Analysis::Block& b) { return b.Computed; });
+	const auto hits =
+	    std::count_if(a.Stores.begin(), a.Stores.end(),
+	                  [](const Analysis::Store& s) { return s.HitsCode; });
+
+	os << path << ": " << a.Blocks.size() << " blocks, " << code
+	   << " code bytes, " << a.Size - code << " data bytes, "
+	   << a.Stores.size() << " stores (" << hits << " may hit code), "
+	   << computed << " computed jumps, " << a.Unknown.size()
+	   << " unknown opcodes" << (a.Escapes ? ", leaves the ROM" : "") << ", "
+	   << (a.safe() ? "safe" : "unsafe") << " to precompile\n";
+}
+
+// Blocks get an L label with their successors, data an 8-byte DB per line
+// and a D label where ANNN points.
+void listing(std::ostream& os, const Rom& rom, const Analysis& a) {
+	const uint32_t end  = Rom::Base + a.Size;
+	const auto     byte = [&](uint32_t addr) -> uint8_t {
+		return addr >= Rom::Base && addr < end ? rom.Data[addr - Rom::Base]
+		                                       : 0;
+	};
+	const auto isCode = [&](uint32_t addr) {
+		return (a.Flags[addr] & Analysis::Code) != 0;
+	};
+
+	os << std::hex << std::uppercase << std::setfill('0');
+	for (uint32_t addr = Rom::Base; addr < end;) {
+		const uint8_t f = a.Flags[addr];
+
+		if (!isCode(addr)) {
+			if (f & Analysis::Pointer) {
+				os << "D" << std::setw(3) << addr << ":\n";
+			}
+			os << "  " << std::setw(3) << addr << "  DB";
+			uint32_t n = 0;
+			do {
+				os << (n == 0 ? " " : ", ") << "0x" << std::setw(2)
+				   << +byte(addr);
+				++addr;
+				++n;
+			} while (addr < end && n != 8 && !isCode(addr) &&
+			         (a.Flags[addr] & Analysis::Pointer) == 0);
+			os << "\n";
+			continue;
+		}
+
+		const auto b = std::lower_bound(
+		    a.Blocks.begin(), a.Blocks.end(), addr,
+		    [](const Analysis::Block& x, uint32_t at) { return x.Start < at; });
+		if (b != a.Blocks.end() && b->Start == addr) {
+			os << "\nL" << std::setw(3) << addr << ":";
+			if (b->Computed) {
+				os << "  ; computed jump";
+			} else if (b->Next.empty()) {
+				os << "  ; returns or exits";
+			} else {
+				os << "  ; next";
+				for (const uint16_t n : b->Next) {
+					os << " " << std::setw(3) << n;
+				}
+			}
+			os << "\n";
+		}
+
+		const uint16_t op  = byte(addr) << 8 | byte(addr + 1);
+		const uint32_t len = a.Variant == Mode::XOChip && op == 0xF000 ? 4 : 2;
+		os << "  " << std::setw(3) << addr << "  " << std::setw(4) << op
+		   << "  " << disasm(op, a.Variant);
+		if (len == 4) {
+			os << " 0x" << std::setw(4)
+			   << (byte(addr + 2) << 8 | byte(addr + 3));
+		}
+
+		const auto s = std::lower_bound(
+		    a.Stores.begin(), a.Stores.end(), addr,
+		    [](const Analysis::Store& x, uint32_t at) { return x.PC < at; });
+		if (s != a.Stores.end() && s->PC == addr) {
+			os << "  ; writes " << std::setw(3) << s->Lo << "-" << std::setw(3)
+			   << s->Hi << (s->HitsCode ? ", may hit code" : "");
+		}
+		if (f & Analysis::Written) { os << "  ; may be overwritten"; }
+		os << "\n";
+		addr += len;
+	}
+	os << std::dec << std::setfill(' ');
+}
+
+// Calls are dashed, blocks ending in a computed jump red.
+void graph(std::ostream& os, const std::string& path, const Analysis& a) {
+	os << std::hex << std::uppercase;
+	os << "digraph \"" << path << "\" {\n";
+	os << "\tnode [shape=box fontname=monospace];\n";
+	for (const auto& b : a.Blocks) {
+		os << "\t\"" << b.Start << "\" [label=\"" << b.Start << "-"
+		   << b.End - 1 << "\"" << (b.Computed ? " color=red" : "") << "];\n";
+		for (size_t i = 0; i != b.Next.size(); ++i) {
+			const bool call = b.Next.size() == 2 && i == 0 &&
+			                  b.Next[1] == b.End;
+			os << "\t\"" << b.Start << "\" -> \"" << b.Next[i] << "\""
+			   << (call ? " [style=dashed]" : "") << ";\n";
+		}
+	}
+	os << "}\n" << std::dec;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+	std::vector<std::string> roms;
+	Mode                     mode   = Mode::Chip8;
+	Quirks                   quirks = Quirks::Default;
+	bool                     force  = false;
+	char                     output = 'l';  // Listing, summary or graph
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		if (arg == "-m" && i + 1 < argc && parse_mode(argv[i + 1], mode)) {
+			++i;
+		} else if (arg == "-q" && i + 1 < argc &&
+		           parse_quirks(argv[i + 1], quirks)) {
+			++i;
+		} else if (arg == "-f") {
+			force = true;
+		} else if (arg == "-s" || arg == "-g") {
+			output = arg[1];
+		} else if (arg[0] == '-') {
+			usage(argv[0]);
+			return -1;
+		} else {
+			roms.emplace_back(argv[i]);
+		}
+	}
+	if (roms.empty()) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	int status = 0;
+	for (const auto& path : roms) {
+		Rom             rom;
+		const LoadError err = rom.open(path.c_str(), rom_limit(mode));
+		if (err != LoadError::None) {
+			std::cerr << path << ": " << describe(err) << "\n";
+			status = -1;
+			continue;
+		}
+
+		const std::string cache =
+		    Analysis::cache_path(path, rom.Hash, mode, quirks);
+		Analysis a;
+		if (force || !a.load(cache) || a.RomHash != rom.Hash ||
+		    a.Size != rom.Size) {
+			a.run(rom, mode, quirks);
+			if (!a.save(cache)) {
+				std::cerr << "can't write analysis cache " << cache << "\n";
+			}
+		}
+
+		switch (output) {
+			case 's': summary(std::cout, path, a); break;
+			case 'g': graph(std::cout, path, a); break;
+			default:
+				summary(std::cout, path, a);
+				listing(std::cout, rom, a);
+				break;
+		}
+	}
+	return status;
+}
@@ -0,0 +1,111 @@
+#include "aot.hh"
+
+#include <cstring>
+#include <vector>
+
+#include "rom.hh"
+
+namespace {
+// Filled by static initializers, so built on first use.
+std::vector<const AotProgram*>& registry() {
+	static std::vector<const AotProgram*> programs;
+	return programs;
+}
+}  // namespace
+
+bool register_aot(const AotProgram& program) {
+	registry().push_back(&program);
+	return true;
+}
+
+const AotProgram* find_aot(uint64_t hash, Mode mode, Quirks quirks) {
+	for (const AotProgram* p : registry()) {
+		if (p->RomHash == hash && p->Variant == mode && p->Quirk == quirks) {
+			return p;
+		}
+	}
+	return nullptr;
+}
+
+void Aot::bind(const Chip8& c8) {
+	RomHash = c8.RomHash;
+	Variant = c8.Variant;
+	Quirk   = c8.Quirk;
+	Bound   = true;
+	Program = find_aot(RomHash, Variant, Quirk);
+
+	Table.fill(nullptr);
+	Checked.reset();
+	Gen = c8.CodeGen;
+	if (Program == nullptr) { return; }
+	for (size_t i = 0; i != Program->BlockCount; ++i) {
+		const AotProgram::Block& b = Program->Blocks[i];
+		if (b.End <= Chip8::CodeSize) { Table[b.Start] = &b; }
+	}
+}
+
+// A block is checked against the ROM once per CodeGen. Decoding its
+// instructions then makes any later store to them bump CodeGen, so it gets
+// checked again.
+bool Aot::check(Chip8& c8, const AotProgram::Block& b) {
+	if (c8.CodeGen != Gen) {
+		Checked.reset();
+		Gen = c8.CodeGen;
+	}
+	const uint8_t* rom  = Program->Bytes + (b.Start - Rom::Base);
+	const bool     same = std::memcmp(&c8.Memory[b.Start], rom,
+	                                  b.End - b.Start) == 0;
+	for (uint16_t addr = b.Start; same && addr < b.End;) {
+		const Instr& in = c8.decoded(addr);
+		addr += c8.Variant == Mode::XOChip && in.OC == 0xF000 ? 4 : 2;
+	}
+	Checked[b.Start] = true;
+	Valid[b.Start]   = same;
+	return same;
+}
+
+// Runs exactly n instructions. Blocks that don't fit in what's left of the
+// budget are interpreted one instruction at a time.
+uint64_t Aot::run(Chip8& c8, uint64_t n) {
+	uint64_t ran = 0;
+
+	// Blocks would bypass the tracer and the profiler.
+	bool interpret = c8.Trace != nullptr;
+#ifdef Profile
+	interpret |= c8.Prof != nullptr;
+#endif
+	if (!interpret && (!Bound || c8.RomHash != RomHash ||
+	                   c8.Variant != Variant || c8.Quirk != Quirk)) {
+		bind(c8);
+	}
+	if (interpret || Program == nullptr) {
+		for (; ran != n; ++ran) {
+			c8.emulate_cycle();
+			if (c8.Idle) { ran += c8.idle(n - ran - 1); }
+		}
+		return ran;
+	}
+
+	while (ran != n) {
+		const uint16_t           pc = c8.PC;
+		const AotProgram::Block* b  = pc < Table.size() ? Table[pc] : nullptr;
+
+		// The check result holds until CodeGen moves.
+		const bool ok =
+		    b != nullptr && b->Count <= n - ran &&
+		    (c8.CodeGen == Gen && Checked[pc] ? Valid[pc] : check(c8, *b));
+		if (!ok) {
+			c8.emulate_cycle();
+			++ran;
+			if (c8.Idle) { ran += c8.idle(n - ran); }
+			continue;
+		}
+
+		const uint16_t count = b->Fn(c8);
+		c8.Cycles += count;
+		Native += count;
+		ran += count;
+		if (c8.Idle) { ran += c8.idle(n - ran); }
+	}
+	return ran;
+}
@@ -0,0 +1,73 @@
+#ifndef _C8E_AOT_HH_
+#define _C8E_AOT_HH_
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+
+#include "chip8.hh"
+
+// Ahead-of-time translations. C8E-aotgen turns known ROMs into a C++ unit
+// with one function per basic block (see analysis.hh), compiled with the
+// rest of the emulator and registered at startup. Simple register ops become
+// plain C++ on Chip8's arrays, everything else calls the interpreter's
+// handler.
+//
+// Blocks only run while the bytes under them still match the ROM they were
+// translated from. Self-modified code, code reached through BNNN that the
+// analysis never saw, and ROMs without a translation are interpreted.
+struct AotProgram {
+	// Runs the block from its start and returns the instructions it ran,
+	// fewer than Count when a handler leaves the block early (FX0A waiting,
+	// a store rewriting code).
+	using Code = uint16_t (*)(Chip8&);
+
+	struct Block {
+		uint16_t Start;
+		uint16_t End;    // Past the last instruction
+		uint16_t Count;  // Instructions in the block
+		Code     Fn;
+	};
+
+	const char*    Name;  // ROM file name, for listings
+	uint64_t       RomHash;
+	Mode           Variant;
+	Quirks         Quirk;
+	const uint8_t* Bytes;  // The ROM as translated
+	uint32_t       Size;
+	const Block*   Blocks;  // By start address
+	size_t         BlockCount;
+};
+
+// Adds program to the registry; generated units call it from a static
+// initializer. Returns true so it can initialize one.
+bool register_aot(const AotProgram& program);
+
+// The translation of the ROM with hash for mode and quirks, or null.
+const AotProgram* find_aot(uint64_t hash, Mode mode, Quirks quirks);
+
+// Runs a machine through the translation of its ROM. Like Jit, one belongs
+// to one Chip8; it looks the program up again whenever the ROM, mode or
+// quirks change.
+struct Aot {
+	const AotProgram* Program{};
+	uint64_t          Native{};  // Instructions run by translated blocks
+
+	std::array<const AotProgram::Block*, Chip8::CodeSize> Table{};  // By PC
+	std::bitset<Chip8::CodeSize> Checked;  // Bytes compared since Gen
+	std::bitset<Chip8::CodeSize> Valid;    // And found unchanged
+
+	uint64_t RomHash{};
+	Mode     Variant{};
+	Quirks   Quirk{};
+	uint32_t Gen{};
+	bool     Bound{};
+
+	uint64_t run(Chip8& c8, uint64_t n);
+
+private:
+	void bind(const Chip8& c8);
+	bool check(Chip8& c8, const AotProgram::Block& b);
+};
+#endif
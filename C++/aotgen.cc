@@ -0,0 +1,314 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "analysis.hh"
+#include "disasm.hh"
+#include "rom.hh"
+
+// Translates ROMs to one C++ unit for aot.hh: per ROM, the ROM bytes, one
+// function per basic block found by Analysis, and a registration. The unit is
+// compiled into the emulator, which runs it in place of the interpreter
+// wherever the bytes still match.
+
+namespace {
+void usage(const char* prog) {
+	std::cerr << "usage: " << prog
+	          << " [-m chip8|schip|xochip] [-q quirks] [-o out.cc] rom...\n";
+}
+
+std::string hex(uint32_t value, int digits) {
+	char buf[16];
+	std::snprintf(buf, sizeof(buf), "0x%0*X", digits, value);
+	return buf;
+}
+
+const char* mode_name(Mode mode) {
+	switch (mode) {
+		case Mode::SChip: return "Mode::SChip";
+		case Mode::XOChip: return "Mode::XOChip";
+		default: return "Mode::Chip8";
+	}
+}
+
+const char* quirks_name(Quirks quirks) {
+	switch (quirks) {
+		case Quirks::VIP: return "Quirks::VIP";
+		case Quirks::CHIP48: return "Quirks::CHIP48";
+		case Quirks::SChip: return "Quirks::SChip";
+		case Quirks::XOChip: return "Quirks::XOChip";
+		default: return "Quirks::Default";
+	}
+}
+
+// C++ for the instruction at pc, one statement per line, or nothing if it
+// needs its handler. The statements match the handlers in chip8.cc except
+// for the PC updates of straight-line code, which are left to the end of the
+// block. XO-CHIP skips depend on the length of what they skip and stay with
+// their handlers.
+std::vector<std::string> inline_code(uint16_t op, uint16_t pc, Mode mode,
+                                     Quirks quirks) {
+	if (!Chip8::known(op, mode)) { return {}; }
+	const Instr       in   = Chip8::decode(op, mode, quirks);
+	const bool        xo   = mode == Mode::XOChip;
+	const uint16_t    mask = xo ? 0xFFFF : 0xFFF;
+	const std::string vx   = "c8.V[" + hex(in.X, 1) + "]";
+	const std::string vy   = "c8.V[" + hex(in.Y, 1) + "]";
+	const std::string nn   = hex(in.NN, 2);
+	const std::string skip =
+	    " ? " + hex(pc + 4, 3) + " : " + hex(pc + 2, 3) + ";";
+	const uint8_t flags = quirk_flags(quirks);
+
+	switch (op & 0xF000) {
+		case 0x0000:
+			if (op == 0x00EE) { return {"c8.PC = c8.Stack[c8.SP--];"}; }
+			return {};
+		case 0x1000:
+			if (pc == in.NNN || ((pc - 4) & mask) == in.NNN) {
+				return {"c8.Idle = true;", "c8.PC   = " + hex(in.NNN, 3) + ";"};
+			}
+			return {"c8.PC = " + hex(in.NNN, 3) + ";"};
+		case 0x2000:
+			return {"c8.Stack[++c8.SP] = " + hex(pc + 2, 3) + ";",
+			        "c8.PC             = " + hex(in.NNN, 3) + ";"};
+		case 0x3000:
+			if (xo) { return {}; }
+			return {"c8.PC = " + vx + " == " + nn + skip};
+		case 0x4000:
+			if (xo) { return {}; }
+			return {"c8.PC = " + vx + " != " + nn + skip};
+		case 0x5000:
+			if (xo) { return {}; }
+			return {"c8.PC = " + vx + " == " + vy + skip};
+		case 0x9000:
+			if (xo) { return {}; }
+			return {"c8.PC = " + vx + " != " + vy + skip};
+		case 0x6000: return {vx + " = " + nn + ";"};
+		case 0x7000: return {vx + " += " + nn + ";"};
+		case 0x8000: {
+			const std::string vf  = "c8.V[0xF]";
+			const std::string src = (flags & ShiftVy) != 0 ? vy : vx;
+			switch (in.N) {
+				case 0x0: return {vx + " = " + vy + ";"};
+				case 0x1:
+				case 0x2:
+				case 0x3: {
+					std::vector<std::string> s{vx + " " + "|&^"[in.N - 1] +
+					                           "= " + vy + ";"};
+					if ((flags & VfReset) != 0) { s.push_back(vf + " = 0;"); }
+					return s;
+				}
+				case 0x4:
+					return {vf + " = " + vx + " + " + vy + " > 255;",
+					        vx + " += " + vy + ";"};
+				case 0x5:
+					return {vf + " = " + vx + " > " + vy + ";",
+					        vx + " -= " + vy + ";"};
+				case 0x6:
+					return {"{", "\tconst uint8_t src = " + src + ";",
+					        "\t" + vf + " = src & 0x1;",
+					        "\t" + vx + " = src >> 1;", "}"};
+				case 0x7:
+					return {vf + " = " + vy + " > " + vx + ";",
+					        vx + " = " + vy + " - " + vx + ";"};
+				case 0xE:
+					return {"{", "\tconst uint8_t src = " + src + ";",
+					        "\t" + vf + " = src >> 7;",
+					        "\t" + vx + " = src << 1;", "}"};
+				default: return {};
+			}
+		}
+		case 0xA000: return {"c8.I = " + hex(in.NNN, 3) + ";"};
+		case 0xF000:
+			switch (in.NN) {
+				case 0x07: return {vx + " = c8.DT;"};
+				case 0x15: return {"c8.DT = " + vx + ";"};
+				case 0x18: return {"c8.ST = " + vx + ";"};
+				case 0x1E: return {"c8.I += " + vx + ";"};
+				default: return {};
+			}
+		default: return {};
+	}
+}
+
+// Control flow sets PC itself; anything else at the end of a block falls
+// through to the next one.
+bool sets_pc(uint16_t op) {
+	switch (op & 0xF000) {
+		case 0x0000: return op == 0x00EE;
+		case 0x1000:
+		case 0x2000:
+		case 0x3000:
+		case 0x4000:
+		case 0x5000:
+		case 0x9000: return true;
+		default: return false;
+	}
+}
+
+// A handler in the middle of a block may not carry on to the next
+// instruction: FX0A waiting for a key holds PC, and a store that rewrites
+// decoded code bumps CodeGen. Either way the block stops there. Returns the
+// instructions in the block.
+uint16_t block(std::ostream& os, const Rom& rom, const Analysis& a,
+               const Analysis::Block& b, std::ostream& handlers) {
+	const auto byte = [&](uint32_t addr) -> uint8_t {
+		return addr - Rom::Base < rom.Size ? rom.Data[addr - Rom::Base] : 0;
+	};
+	const auto word = [&](uint32_t addr) -> uint16_t {
+		return byte(addr) << 8 | byte(addr + 1);
+	};
+	const auto length = [&](uint32_t pc) -> uint32_t {
+		return a.Variant == Mode::XOChip && word(pc) == 0xF000 ? 4 : 2;
+	};
+
+	std::ostringstream body;
+	uint16_t           count  = 0;
+	uint16_t           lastOC = 0;
+	bool               synced = false;
+	bool               early  = false;  // Some handler may stop the block
+	for (uint32_t pc = b.Start; pc != b.End; pc += length(pc)) {
+		const uint16_t op   = word(pc);
+		const uint32_t next = pc + length(pc);
+		lastOC              = op;
+		++count;
+
+		body << "\t// " << hex(pc, 3).substr(2) << "  "
+		     << hex(op, 4).substr(2) << "  " << disasm(op, a.Variant) << "\n";
+		const std::vector<std::string> lines =
+		    inline_code(op, pc, a.Variant, a.Quirk);
+		if (!lines.empty()) {
+			for (const auto& line : lines) { body << "\t" << line << "\n"; }
+			synced = sets_pc(op);
+			if (synced) { body << "\tc8.OC = " << hex(op, 4) << ";\n"; }
+			continue;
+		}
+
+		const std::string k = "k" + hex(pc, 3).substr(2);
+		handlers << "const Instr " << k << " = Chip8::decode(" << hex(op, 4)
+		         << ", " << mode_name(a.Variant) << ", "
+		         << quirks_name(a.Quirk) << ");\n";
+		body << "\tc8.PC = " << hex(pc, 3) << ";\n";
+		body << "\tc8.OC = " << hex(op, 4) << ";\n";
+		body << "\t" << k << ".Fn(c8, " << k << ");\n";
+		synced = true;
+		if (next != b.End) {
+			body << "\tif (c8.PC != " << hex(next, 3)
+			     << " || c8.CodeGen != gen) { return " << count << "; }\n";
+			early = true;
+		}
+	}
+	if (!synced) {
+		body << "\tc8.PC = " << hex(b.End, 3) << ";\n";
+		body << "\tc8.OC = " << hex(lastOC, 4) << ";\n";
+	}
+
+	os << "uint16_t b" << hex(b.Start, 3).substr(2) << "(Chip8& c8) {\n";
+	if (early) { os << "\tconst uint32_t gen = c8.CodeGen;\n"; }
+	os << body.str() << "\treturn " << count << ";\n}\n\n";
+	return count;
+}
+
+// Blocks that run past the ROM or the decode cache are left out; the
+// interpreter runs them.
+void program(std::ostream& os, const std::string& path, const Rom& rom,
+             const Analysis& a) {
+	const std::string hash = hex(rom.Hash >> 32, 8) +
+	                         hex(rom.Hash & 0xFFFFFFFF, 8).substr(2);
+	const std::string name = "r" + hash.substr(2) + "_" +
+	                         std::to_string(uint8_t(a.Variant)) + "_" +
+	                         std::to_string(uint8_t(a.Quirk));
+	std::string file = path.substr(path.find_last_of('/') + 1);
+	for (char& c : file) {
+		if (c == '"' || c == '\\') { c = '_'; }
+	}
+
+	os << "// " << file << "\n";
+	os << "namespace " << name << " {\n";
+	os << "const uint8_t Bytes[] = {";
+	for (uint32_t i = 0; i != rom.Size; ++i) {
+		os << (i % 12 == 0 ? "\n\t" : " ") << hex(rom.Data[i], 2) << ",";
+	}
+	os << "\n};\n\n";
+
+	std::ostringstream handlers;
+	std::ostringstream blocks;
+	std::ostringstream table;
+	for (const auto& b : a.Blocks) {
+		if (b.End <= b.Start || b.End > Rom::Base + rom.Size ||
+		    b.End > Chip8::CodeSize) {
+			continue;
+		}
+		const uint16_t count = block(blocks, rom, a, b, handlers);
+		table << "\t{" << hex(b.Start, 3) << ", " << hex(b.End, 3) << ", "
+		      << count << ", b" << hex(b.Start, 3).substr(2) << "},\n";
+	}
+	os << handlers.str() << "\n" << blocks.str();
+	os << "const AotProgram::Block Blocks[] = {\n" << table.str() << "};\n\n";
+	os << "const AotProgram Program{\"" << file << "\", " << hash << "ULL, "
+	   << mode_name(a.Variant) << ", " << quirks_name(a.Quirk)
+	   << ", Bytes, sizeof(Bytes), Blocks, std::size(Blocks)};\n";
+	os << "const bool Registered = register_aot(Program);\n";
+	os << "}  // namespace " << name << "\n\n";
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+	std::vector<std::string> roms;
+	Mode                     mode    = Mode::Chip8;
+	Quirks                   quirks  = Quirks::Default;
+	const char*              outPath = nullptr;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		if (arg == "-m" && i + 1 < argc && parse_mode(argv[i + 1], mode)) {
+			++i;
+		} else if (arg == "-q" && i + 1 < argc &&
+		           parse_quirks(argv[i + 1], quirks)) {
+			++i;
+		} else if (arg == "-o" && i + 1 < argc) {
+			outPath = argv[++i];
+		} else if (arg[0] == '-') {
+			usage(argv[0]);
+			return -1;
+		} else {
+			roms.emplace_back(argv[i]);
+		}
+	}
+
+	// Bad ROMs are reported and left out, so the unit always builds.
+	std::ostringstream os;
+	std::set<uint64_t> seen;
+	int                status = 0;
+	for (const auto& path : roms) {
+		Rom             rom;
+		const LoadError err = rom.open(path.c_str(), rom_limit(mode));
+		if (err != LoadError::None) {
+			std::cerr << path << ": " << describe(err) << "\n";
+			status = -1;
+			continue;
+		}
+		if (!seen.insert(rom.Hash).second) { continue; }
+
+		Analysis a;
+		a.run(rom, mode, quirks);
+		program(os, path, rom, a);
+	}
+
+	std::ofstream file;
+	if (outPath != nullptr) { file.open(outPath); }
+	std::ostream& out = outPath != nullptr ? file : std::cout;
+	out << "// Generated by C8E-aotgen. Do not edit.\n\n";
+	out << "#include <iterator>\n\n#include \"aot.hh\"\n\n";
+	out << "namespace {\n" << os.str() << "}  // namespace\n";
+	if (!out) {
+		std::cerr << "can't write " << outPath << "\n";
+		return -1;
+	}
+	return status;
+}
@@ -0,0 +1,65 @@
+#include "audio.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+void Audio::push(const Chip8& c8) {
+	const Tone tone{c8.ST != 0, c8.Variant == Mode::XOChip, c8.Pitch,
+	                c8.Pattern};
+	if (!Queue.push(tone)) { Dropped.fetch_add(1, std::memory_order_relaxed); }
+}
+
+// Called from the SDL callback (or a NullSink); touches nothing the
+// emulation thread writes except through Queue.
+void Audio::render(int16_t* out, size_t count) {
+	for (size_t i = 0; i != count; ++i) {
+		if (Left == 0) {
+			if (!Primed) {
+				if (Queue.size() < Prime) {
+					std::fill_n(out + i, count - i, 0);
+					return;
+				}
+				Primed = true;
+			}
+			while (Queue.size() > MaxQueued) { Queue.pop(Current); }
+			if (!Queue.pop(Current)) {
+				Underruns.fetch_add(1, std::memory_order_relaxed);
+				Primed = false;
+				std::fill_n(out + i, count - i, 0);
+				return;
+			}
+
+			// XO-CHIP plays 4000 * 2^((pitch - 64) / 48) pattern bits/sec.
+			Step = Current.UsePattern
+			           ? 4000 * std::exp2((Current.Pitch - 64) / 48.0) /
+			                 SampleRate
+			           : BeepHz / SampleRate;
+			Left = SamplesPerTick;
+		}
+
+		int16_t sample = 0;
+		if (Current.On) {
+			bool high;
+			if (Current.UsePattern) {
+				const uint8_t bit = static_cast<uint8_t>(Phase) & 127;
+				high = (Current.Pattern[bit / 8] >> (7 - bit % 8)) & 1;
+			} else {
+				high = Phase - std::floor(Phase) < 0.5;
+			}
+			sample = high ? Volume : -Volume;
+		}
+		out[i] = sample;
+
+		Phase += Step;
+		if (Phase >= 128) { Phase -= 128; }
+		--Left;
+	}
+}
+
+void NullSink::pull(Audio& audio, size_t count) {
+	std::vector<int16_t> buf(count);
+	audio.render(buf.data(), count);
+	Samples += count;
+	Audible += count - std::count(buf.begin(), buf.end(), 0);
+}
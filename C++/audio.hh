@@ -0,0 +1,62 @@
+#ifndef _C8E_AUDIO_HH_
+#define _C8E_AUDIO_HH_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "chip8.hh"
+#include "spsc.hh"
+
+// Sound output. The emulation thread pushes the sound state once per 60 Hz
+// timer tick (the scheduler does this when Scheduler::Sound is set); the
+// audio thread renders one tick's worth of samples per state it pops. A
+// plain CHIP-8 beeps a square wave while ST is non-zero, XO-CHIP plays its
+// 128-bit pattern at Pitch instead.
+//
+// Neither side blocks. A full ring drops the newest state; when the
+// emulator has run ahead the consumer skips to the newest states so latency
+// stays within MaxQueued ticks, and when it runs dry it goes quiet and
+// primes again rather than repeating a stale tone.
+struct Audio {
+	static constexpr uint32_t SampleRate     = 48000;
+	static constexpr uint32_t SamplesPerTick = SampleRate / 60;
+	static constexpr size_t   MaxQueued      = 4;  // Ticks
+	static constexpr int16_t  Volume         = 3000;
+	static constexpr double   BeepHz         = 440;
+
+	struct Tone {
+		bool                    On;
+		bool                    UsePattern;  // XO-CHIP
+		uint8_t                 Pitch;
+		std::array<uint8_t, 16> Pattern;
+	};
+
+	SpscRing<Tone, 64> Queue;
+	uint32_t           Prime{2};  // Ticks queued before sound (re)starts
+
+	// Statistics, readable from either thread.
+	std::atomic<uint64_t> Dropped{};    // Producer found the ring full
+	std::atomic<uint64_t> Underruns{};  // Consumer found it empty
+
+	void push(const Chip8& c8);               // Emulation thread
+	void render(int16_t* out, size_t count);  // Audio thread
+
+private:
+	Tone     Current{};
+	bool     Primed{};
+	uint32_t Left{};   // Samples left of Current
+	double   Phase{};  // Cycles for the beep, pattern bits for XO-CHIP
+	double   Step{};   // Phase advance per sample
+};
+
+// Pulls samples the way an audio device would and throws them away, keeping
+// counts. Lets headless runs exercise the audio path without a device.
+struct NullSink {
+	uint64_t Samples{};
+	uint64_t Audible{};  // Non-zero samples
+
+	void pull(Audio& audio, size_t count);
+};
+#endif
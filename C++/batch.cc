@@ -0,0 +1,345 @@
+#include "batch.hh"
+
+#include <algorithm>
+
+namespace {
+// Lane sets an instruction is applied to. Every lane is a plain counted loop
+// over contiguous arrays, which is what gets vectorised.
+struct AllLanes {
+	size_t N;
+
+	template <typename F>
+	void operator()(F f) const {
+		for (size_t i = 0; i != N; ++i) { f(i); }
+	}
+};
+
+// Lanes sharing a PC once the batch has diverged, chained through Next.
+struct LaneChain {
+	int32_t        Head;
+	const int32_t* Next;
+
+	template <typename F>
+	void operator()(F f) const {
+		for (int32_t i = Head; i != -1; i = Next[i]) { f(i); }
+	}
+};
+
+struct OneLane {
+	size_t L;
+
+	template <typename F>
+	void operator()(F f) const {
+		f(L);
+	}
+};
+
+template <typename Each>
+void exec(Batch& b, const Instr& in, Each each) {
+	uint8_t*       vx    = b.v(in.X);
+	uint8_t*       vy    = b.v(in.Y);
+	uint8_t*       vf    = b.v(0xF);
+	uint16_t*      pc    = b.PC.data();
+	uint16_t*      ir    = b.I.data();
+	uint8_t*       sp    = b.SP.data();
+	uint16_t*      stack = b.Stack.data();
+	uint8_t*       mem   = b.Memory.data();
+	const uint8_t  nn    = in.NN;
+	const uint16_t nnn   = in.NNN;
+
+	auto store = [&](size_t i, uint16_t addr, uint8_t value) {
+		addr &= 0xFFF;
+		mem[i * 4096 + addr] = value;
+		b.Written[addr]      = true;
+	};
+	auto next = [&](size_t i) { pc[i] += 2; };
+
+	switch (in.OC & 0xF000) {
+		case 0x0000:
+			if (in.OC == 0x00E0) {
+				each([&](size_t i) {
+					std::fill_n(&b.Display[i * 32], 32, 0);
+					pc[i] += 2;
+				});
+			} else if (in.OC == 0x00EE) {
+				each([&](size_t i) {
+					pc[i] = stack[i * 16 + (sp[i] & 0xF)];
+					--sp[i];
+				});
+			} else {
+				each(next);
+			}
+			break;
+		case 0x1000:
+			each([&](size_t i) { pc[i] = nnn; });
+			break;
+		case 0x2000:
+			each([&](size_t i) {
+				++sp[i];
+				stack[i * 16 + (sp[i] & 0xF)] = pc[i] + 2;
+				pc[i]                         = nnn;
+			});
+			break;
+		case 0x3000:
+			each([&](size_t i) { pc[i] += vx[i] == nn ? 4 : 2; });
+			break;
+		case 0x4000:
+			each([&](size_t i) { pc[i] += vx[i] != nn ? 4 : 2; });
+			break;
+		case 0x5000:
+			each([&](size_t i) { pc[i] += vx[i] == vy[i] ? 4 : 2; });
+			break;
+		case 0x6000:
+			each([&](size_t i) { vx[i] = nn, pc[i] += 2; });
+			break;
+		case 0x7000:
+			each([&](size_t i) { vx[i] += nn, pc[i] += 2; });
+			break;
+		case 0x8000:
+			// Same statement order as the handlers, so X or Y == F behaves the
+			// same way.
+			switch (in.N) {
+				case 0x0: each([&](size_t i) { vx[i] = vy[i]; }); break;
+				case 0x1: each([&](size_t i) { vx[i] |= vy[i]; }); break;
+				case 0x2: each([&](size_t i) { vx[i] &= vy[i]; }); break;
+				case 0x3: each([&](size_t i) { vx[i] ^= vy[i]; }); break;
+				case 0x4:
+					each([&](size_t i) {
+						vf[i] = (vx[i] + vy[i]) > 255 ? 1 : 0;
+						vx[i] += vy[i];
+					});
+					break;
+				case 0x5:
+					each([&](size_t i) {
+						vf[i] = vx[i] > vy[i];
+						vx[i] -= vy[i];
+					});
+					break;
+				case 0x6:
+					each([&](size_t i) {
+						vf[i] = vx[i] & 0x1;
+						vx[i] >>= 1;
+					});
+					break;
+				case 0x7:
+					each([&](size_t i) {
+						vf[i] = vy[i] > vx[i];
+						vx[i] = vy[i] - vx[i];
+					});
+					break;
+				case 0xE:
+					each([&](size_t i) {
+						vf[i] = vx[i] >> 7;
+						vx[i] <<= 1;
+					});
+					break;
+				default: break;
+			}
+			each(next);
+			break;
+		case 0x9000:
+			each([&](size_t i) { pc[i] += vx[i] != vy[i] ? 4 : 2; });
+			break;
+		case 0xA000:
+			each([&](size_t i) { ir[i] = nnn, pc[i] += 2; });
+			break;
+		case 0xB000: {
+			const uint8_t* v0 = b.v(0);
+			each([&](size_t i) { pc[i] = nnn + v0[i]; });
+			break;
+		}
+		case 0xC000:
+			each([&](size_t i) {
+				vx[i] = b.Rng[i].next() & nn;
+				pc[i] += 2;
+			});
+			break;
+		case 0xD000:
+			each([&](size_t i) {
+				const uint8_t xPos = vx[i] % 64;
+				const uint8_t yPos = vy[i] % 32;
+				const uint8_t rows = std::min<uint8_t>(in.N, 32 - yPos);
+
+				vf[i] = 0;
+				for (uint8_t row = 0; row != rows; ++row) {
+					const uint64_t sprite =
+					    uint64_t{mem[i * 4096 + ((ir[i] + row) & 0xFFF)]} << 56 >>
+					    xPos;
+					uint64_t& line = b.Display[i * 32 + yPos + row];
+
+					if ((line & sprite) != 0) { vf[i] = 1; }
+					line ^= sprite;
+				}
+				pc[i] += 2;
+			});
+			break;
+		case 0xE000: {
+			const uint16_t* keys = b.Keys.data();
+			if (nn == 0x9E) {
+				each([&](size_t i) {
+					pc[i] += (keys[i] >> (vx[i] & 0xF)) & 1 ? 4 : 2;
+				});
+			} else if (nn == 0xA1) {
+				each([&](size_t i) {
+					pc[i] += (keys[i] >> (vx[i] & 0xF)) & 1 ? 2 : 4;
+				});
+			} else {
+				each(next);
+			}
+			break;
+		}
+		case 0xF000:
+			switch (nn) {
+				case 0x07: each([&](size_t i) { vx[i] = b.DT[i]; }); break;
+				case 0x0A:
+					// Waits in place until a key is held; the highest one wins.
+					each([&](size_t i) {
+						if (b.Keys[i] != 0) {
+							vx[i] = 31 - __builtin_clz(b.Keys[i]);
+							pc[i] += 2;
+						}
+					});
+					return;
+				case 0x15: each([&](size_t i) { b.DT[i] = vx[i]; }); break;
+				case 0x18: each([&](size_t i) { b.ST[i] = vx[i]; }); break;
+				case 0x1E: each([&](size_t i) { ir[i] += vx[i]; }); break;
+				case 0x29: each([&](size_t i) { ir[i] = 5 * vx[i]; }); break;
+				case 0x33:
+					each([&](size_t i) {
+						store(i, ir[i], (vx[i] % 1000) / 100);
+						store(i, ir[i] + 1, (vx[i] % 100) / 10);
+						store(i, ir[i] + 2, vx[i] % 10);
+					});
+					break;
+				case 0x55:
+					each([&](size_t i) {
+						for (uint8_t r = 0; r <= in.X; ++r) {
+							store(i, ir[i] + r, b.v(r)[i]);
+						}
+					});
+					break;
+				case 0x65:
+					each([&](size_t i) {
+						for (uint8_t r = 0; r <= in.X; ++r) {
+							b.v(r)[i] = mem[i * 4096 + ((ir[i] + r) & 0xFFF)];
+						}
+					});
+					break;
+				default: break;
+			}
+			each(next);
+			break;
+		default: each(next); break;
+	}
+}
+}  // namespace
+
+Batch::Batch(const std::vector<Chip8>& machines)
+    : Lanes(machines.size()),
+      Regs(16 * Lanes),
+      PC(Lanes),
+      I(Lanes),
+      SP(Lanes),
+      DT(Lanes),
+      ST(Lanes),
+      Keys(Lanes),
+      Stack(16 * Lanes),
+      Display(32 * Lanes),
+      Memory(4096 * Lanes),
+      Rng(Lanes),
+      Next(Lanes) {
+	Head.fill(-1);
+	for (size_t i = 0; i != Lanes; ++i) { load(i, machines[i]); }
+}
+
+void Batch::load(size_t lane, const Chip8& c8) {
+	for (uint8_t x = 0; x != 16; ++x) { v(x)[lane] = c8.V[x]; }
+	PC[lane]   = c8.PC;
+	I[lane]    = c8.I;
+	SP[lane]   = c8.SP;
+	DT[lane]   = c8.DT;
+	ST[lane]   = c8.ST;
+	Keys[lane] = 0;
+	for (uint8_t k = 0; k != 16; ++k) { Keys[lane] |= (c8.Key[k] != 0) << k; }
+	std::copy(c8.Stack.begin(), c8.Stack.end(), &Stack[lane * 16]);
+	std::copy_n(c8.Display[0].begin(), 32, &Display[lane * 32]);
+	std::copy_n(c8.Memory.begin(), 4096, &Memory[lane * 4096]);
+	Rng[lane] = c8.Rng;
+}
+
+void Batch::store(size_t lane, Chip8& c8) const {
+	for (uint8_t x = 0; x != 16; ++x) { c8.V[x] = Regs[x * Lanes + lane]; }
+	c8.PC = PC[lane];
+	c8.I  = I[lane];
+	c8.SP = SP[lane];
+	c8.DT = DT[lane];
+	c8.ST = ST[lane];
+	for (uint8_t k = 0; k != 16; ++k) { c8.Key[k] = (Keys[lane] >> k) & 1; }
+	std::copy_n(&Stack[lane * 16], 16, c8.Stack.begin());
+	std::copy_n(&Display[lane * 32], 32, c8.Display[0].begin());
+	std::copy_n(&Memory[lane * 4096], 4096, c8.Memory.begin());
+	c8.Rng       = Rng[lane];
+	c8.DirtyRows = ~0ULL;
+	c8.invalidate_code();
+}
+
+// One instruction on every lane.
+void Batch::step() {
+	const uint16_t pc0 = PC[0];
+
+	bool same = true;
+	for (size_t i = 0; i != Lanes; ++i) { same &= PC[i] == pc0; }
+
+	const uint16_t at   = pc0 & 0xFFF;
+	const uint16_t next = (at + 1) & 0xFFF;
+	const uint16_t op   = Memory[at] << 8 | Memory[next];
+	if (same && (Written[at] || Written[next])) {
+		for (size_t i = 1; i != Lanes && same; ++i) {
+			same = (Memory[i * 4096 + at] << 8 | Memory[i * 4096 + next]) == op;
+		}
+	}
+
+	if (same) {
+		++Uniform;
+		exec(*this, Chip8::decode(op), AllLanes{Lanes});
+		return;
+	}
+
+	// Diverged: bucket lanes by PC and run each bucket as a group. Lanes
+	// sitting on code some lane has rewritten decode their own opcode.
+	++Divergent;
+	const auto own = [&](size_t i) {
+		const uint16_t a = PC[i] & 0xFFF;
+		const uint16_t o =
+		    Memory[i * 4096 + a] << 8 | Memory[i * 4096 + ((a + 1) & 0xFFF)];
+		exec(*this, Chip8::decode(o), OneLane{i});
+	};
+	Touched.clear();
+	for (size_t i = 0; i != Lanes; ++i) {
+		const uint16_t a = PC[i] & 0xFFF;
+		if (Written[a] || Written[(a + 1) & 0xFFF]) {
+			own(i);
+			continue;
+		}
+		if (Head[a] == -1) { Touched.push_back(a); }
+		Next[i] = Head[a];
+		Head[a] = i;
+	}
+	// A lane that already ran this step may have stored over a bucket's code
+	// in lane 0's copy. The bucket's lanes haven't run yet, so their own
+	// copies still hold what they're about to execute.
+	for (auto a : Touched) {
+		if (Written[a] || Written[(a + 1) & 0xFFF]) {
+			for (int32_t i = Head[a]; i != -1; i = Next[i]) { own(i); }
+		} else {
+			const uint16_t o = Memory[a] << 8 | Memory[(a + 1) & 0xFFF];
+			exec(*this, Chip8::decode(o), LaneChain{Head[a], Next.data()});
+		}
+		Head[a] = -1;
+	}
+}
+
+void Batch::tick_timers() {
+	for (size_t i = 0; i != Lanes; ++i) { DT[i] -= DT[i] > 0; }
+	for (size_t i = 0; i != Lanes; ++i) { ST[i] -= ST[i] > 0; }
+}
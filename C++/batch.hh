@@ -0,0 +1,58 @@
+#ifndef _C8E_BATCH_HH_
+#define _C8E_BATCH_HH_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "chip8.hh"
+
+// Many machines running the same ROM in lockstep, stored structure-of-arrays:
+// each register is one contiguous run over all lanes, likewise PC, I, the
+// timers and the packed displays. While every lane sits at the same PC, one
+// decoded instruction is applied to all of them with plain loops the compiler
+// turns into SSE/AVX2. Once lanes diverge they fall back to scalar code until
+// they meet again; lanes that share a PC are still stepped together.
+//
+// Semantics follow Chip8::emulate_cycle in Mode::Chip8 with the default
+// quirks; lanes can be loaded from and stored back into Chip8 instances for
+// setup and comparison. Only the low 4 KB and the 64x32 plane are carried.
+struct Batch {
+	size_t Lanes;
+
+	std::vector<uint8_t>  Regs;  // V[x] of lane i at x * Lanes + i
+	std::vector<uint16_t> PC;
+	std::vector<uint16_t> I;
+	std::vector<uint8_t>  SP;
+	std::vector<uint8_t>  DT;
+	std::vector<uint8_t>  ST;
+	std::vector<uint16_t> Keys;     // Bit k set when key k is down
+	std::vector<uint16_t> Stack;    // Lane i at i * 16
+	std::vector<uint64_t> Display;  // Lane i rows at i * 32
+	std::vector<uint8_t>  Memory;   // Lane i at i * 4096
+
+	std::vector<Random> Rng;
+
+	// Addresses some lane has stored to. Opcodes elsewhere are read from lane
+	// 0 only, since every lane loaded the same ROM.
+	std::array<bool, 4096> Written{};
+
+	uint64_t Uniform{};    // Steps run on all lanes at once
+	uint64_t Divergent{};  // Steps run per PC group
+
+	// Per-step grouping of lanes by PC: Head[pc] starts a chain through Next.
+	std::array<int32_t, 4096> Head{};
+	std::vector<int32_t>      Next;
+	std::vector<uint16_t>     Touched;
+
+	explicit Batch(const std::vector<Chip8>& machines);
+
+	void step();
+	void tick_timers();
+	void load(size_t lane, const Chip8& c8);
+	void store(size_t lane, Chip8& c8) const;
+
+	uint8_t* v(uint8_t x) { return &Regs[x * Lanes]; }
+};
+#endif
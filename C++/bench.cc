@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "aot.hh"
+#include "chip8.hh"
+#include "jit.hh"
+#include "library.hh"
+#include "scheduler.hh"
+
+// Throughput benchmark: runs every ROM in a directory (or the ROMs given) for
+// a fixed instruction budget, unthrottled, with timers ticking at the usual
+// cadence for the rate. Writes JSON so runs can be diffed between changes.
+
+namespace {
+void usage(const char* prog) {
+	std::cerr << "usage: " << prog
+	          << " [-c cycles] [-r ips] [-n repeats] [-b interp|jit|aot]"
+	             " [-o out.json] [dir | rom...]\n";
+}
+
+struct Result {
+	std::string Rom;
+	uint64_t    Cycles{};   // Interpreted, not counting idle skips
+	uint64_t    Skipped{};  // Rest of the budget, waits accounted for by idle()
+	uint64_t    Draws{};    // DXYN executed
+	double      Seconds{};  // Best of the repeats
+};
+
+void add_dir(std::vector<std::string>& roms, const char* dir) {
+	RomLibrary lib;
+	lib.scan(dir);
+	for (const auto& e : lib.Entries) { roms.push_back(lib.path(e)); }
+}
+
+void reset(Chip8& c8, const Rom& rom) {
+	c8.init_or_reset();
+	c8.seed(0);
+	c8.load_rom(rom);
+}
+
+// Timed run. Ticks are paced by instruction count so every repeat executes
+// the same instruction stream. Cycles Chip8::idle() skips are left to
+// skipped, so only instructions actually run count towards the rates.
+double timed_run(const Rom& rom, uint64_t cycles, uint32_t rate,
+                 std::string_view backend, uint64_t& skipped) {
+	Chip8     c8;
+	Jit       recompiler;
+	Aot       translated;
+	Scheduler sched;
+	sched.Rate = rate;
+	if (backend == "jit") { sched.Recompiler = &recompiler; }
+	if (backend == "aot") { sched.Translated = &translated; }
+
+	reset(c8, rom);
+	const auto start = std::chrono::steady_clock::now();
+	for (uint64_t ran = 0; ran != cycles;) {
+		ran += sched.step_tick(c8, cycles - ran);
+	}
+	const double seconds =
+	    std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+	        .count();
+	skipped = c8.Skipped;
+	return seconds;
+}
+
+// Untimed replay of the same stream counting DXYN, so the timed loop
+// carries no instrumentation. One instruction at a time never skips, but
+// what the timed run skips are waits (FX0A, 00FD, the FX07 loop), never
+// DXYN, so the count is the same.
+uint64_t count_draws(const Rom& rom, uint64_t cycles, uint32_t rate) {
+	Chip8     c8;
+	Scheduler sched;
+	sched.Rate = rate;
+
+	reset(c8, rom);
+	uint64_t draws = 0;
+	for (uint64_t ran = 0; ran != cycles;) {
+		const uint64_t n = sched.step_tick(c8, 1);
+		draws += n != 0 && (c8.OC & 0xF000) == 0xD000;
+		ran += n;
+	}
+	return draws;
+}
+
+void write_string(std::ostream& os, std::string_view s) {
+	os << '"';
+	for (char c : s) {
+		if (c == '"' || c == '\\') { os << '\\'; }
+		os << c;
+	}
+	os << '"';
+}
+
+void write_json(std::ostream& os, const std::vector<Result>& results,
+                std::string_view backend, uint32_t rate) {
+	uint64_t cycles = 0, skipped = 0, draws = 0;
+	double   seconds = 0;
+
+	os << "{\n  \"backend\": ";
+	write_string(os, backend);
+	os << ",\n  \"rate\": " << rate << ",\n  \"roms\": [";
+	for (size_t i = 0; i != results.size(); ++i) {
+		const Result& r = results[i];
+		os << (i == 0 ? "\n" : ",\n") << "    {\"rom\": ";
+		write_string(os, r.Rom);
+		os << ", \"instructions\": " << r.Cycles
+		   << ", \"skipped\": " << r.Skipped << ", \"seconds\": " << r.Seconds
+		   << ", \"ips\": " << r.Cycles / r.Seconds
+		   << ", \"ns_per_instruction\": " << r.Seconds * 1e9 / r.Cycles
+		   << ", \"dxyn_share\": " << double(r.Draws) / r.Cycles << "}";
+		cycles += r.Cycles, skipped += r.Skipped, draws += r.Draws;
+		seconds += r.Seconds;
+	}
+	os << "\n  ],\n  \"total\": {\"instructions\": " << cycles
+	   << ", \"skipped\": " << skipped << ", \"seconds\": " << seconds
+	   << ", \"ips\": " << cycles / seconds
+	   << ", \"ns_per_instruction\": " << seconds * 1e9 / cycles
+	   << ", \"dxyn_share\": " << double(draws) / cycles << "}\n}\n";
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+	std::vector<std::string> roms;
+	const char*              outPath = nullptr;
+	std::string_view         backend = "interp";
+	uint64_t                 cycles  = 10'000'000;
+	uint32_t                 rate    = Scheduler{}.Rate;
+	uint32_t                 repeats = 3;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		if (arg == "-c" && i + 1 < argc) {
+			cycles = std::strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "-r" && i + 1 < argc) {
+			rate = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "-n" && i + 1 < argc) {
+			repeats = std::max(1UL, std::strtoul(argv[++i], nullptr, 10));
+		} else if (arg == "-b" && i + 1 < argc) {
+			backend = argv[++i];
+		} else if (arg == "-o" && i + 1 < argc) {
+			outPath = argv[++i];
+		} else if (arg[0] == '-') {
+			usage(argv[0]);
+			return -1;
+		} else if (std::filesystem::is_directory(argv[i])) {
+			add_dir(roms, argv[i]);
+		} else {
+			roms.push_back(argv[i]);
+		}
+	}
+	// Default to the bundled ROMs, as seen from the build directory.
+	if (roms.empty() && std::filesystem::is_directory("../ROMs")) {
+		add_dir(roms, "../ROMs");
+	}
+	if (roms.empty() || cycles == 0 || rate == 0 ||
+	    (backend != "interp" && backend != "jit" && backend != "aot")) {
+		usage(argv[0]);
+		return -1;
+	}
+	std::sort(roms.begin(), roms.end());
+
+	std::vector<Result> results;
+	for (const auto& path : roms) {
+		Rom rom;
+		if (const LoadError err = rom.open(path.c_str());
+		    err != LoadError::None) {
+			std::cerr << path << ": " << describe(err) << "\n";
+			continue;
+		}
+
+		Result r;
+		r.Rom     = std::filesystem::path(path).filename().string();
+		r.Draws   = count_draws(rom, cycles, rate);
+		r.Seconds = timed_run(rom, cycles, rate, backend, r.Skipped);
+		for (uint32_t i = 1; i < repeats; ++i) {
+			const double s = timed_run(rom, cycles, rate, backend, r.Skipped);
+			r.Seconds      = std::min(r.Seconds, s);
+		}
+		r.Cycles = cycles - r.Skipped;
+		results.push_back(r);
+	}
+
+	std::ofstream file;
+	if (outPath != nullptr) { file.open(outPath); }
+	write_json(outPath != nullptr ? file : std::cout, results, backend, rate);
+	return 0;
+}
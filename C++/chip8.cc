@@ -1,18 +1,44 @@
 #include "chip8.hh"
 
-#include <ctime>
+#include <algorithm>
 #include <fstream>
-#include <iostream>
-
-#ifdef Debug
-#define LOG(x) std::cerr << x << "\n"
-#define UNKNOWN_INS \
-	std::cerr << "Unknown Instruction: " << std::hex << OC << "\n"
-#else
-#define LOG(x)
-#define UNKNOWN_INS
+#include <string_view>
+
+#include "rom.hh"
+#include "trace.hh"
+#ifdef Profile
+#include "profiler.hh"
 #endif
 
+namespace {
+constexpr uint16_t BigFont = 0x50;  // 8x10 digits for FX30, after the 4x5 set
+
+void power_on(Chip8& c8) {
+	c8.Cycles  = 0;
+	c8.Skipped = 0;
+	c8.Idle    = false;
+
+	c8.DT = 0;
+	c8.I  = 0;
+	c8.OC = 0;
+	c8.PC = 0x200;
+	c8.SP = 0;
+	c8.ST = 0;
+
+	c8.HiRes  = false;
+	c8.Planes = 1;
+	c8.Pitch  = 64;
+
+	c8.V.fill(0);
+	c8.Key.fill(0);
+	c8.Stack.fill(0);
+	c8.Flags.fill(0);
+	c8.Pattern.fill(0);
+	c8.Display.fill({});
+	c8.DirtyRows = ~0ULL;
+}
+}  // namespace
+
 void Chip8::init_or_reset() {
 	constexpr std::array<uint8_t, 80> font_set{
 	    0xF0, 0x90, 0x90, 0x90, 0xF0,  // 0
@@ -32,297 +58,980 @@ void Chip8::init_or_reset() {
 	    0xF0, 0x80, 0xF0, 0x80, 0xF0,  // E
 	    0xF0, 0x80, 0xF0, 0x80, 0x80,  // F
 	};
+	constexpr std::array<uint8_t, 160> big_font_set{
+	    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C,  // 0
+	    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C,  // 1
+	    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF,  // 2
+	    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C,  // 3
+	    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06,  // 4
+	    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C,  // 5
+	    0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C,  // 6
+	    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60,  // 7
+	    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C,  // 8
+	    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C,  // 9
+	    0x18, 0x3C, 0x66, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,  // A
+	    0xFC, 0xFE, 0xC3, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xFE, 0xFC,  // B
+	    0x3C, 0x7E, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0x7E, 0x3C,  // C
+	    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,  // D
+	    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,  // E
+	    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0,  // F
+	};
+
+	power_on(*this);
+	RomHash = 0;
 
-	DT = 0;
-	I  = 0;
-	OC = 0;
-	PC = 0x200;
-	SP = 0;
-	ST = 0;
-
-	V.fill(0);
-	Key.fill(0);
-	Stack.fill(0);
-	Display.fill(0);
 	Memory.fill(0);
+	invalidate_code();
 
 	// Load font_set into Memory
 	std::copy(font_set.begin(), font_set.end(), Memory.begin());
+	if (Variant != Mode::Chip8) {
+		std::copy(big_font_set.begin(), big_font_set.end(), &Memory[BigFont]);
+	}
+
+	Rng.seed(Seed);
+}
+
+void Chip8::seed(uint32_t s) {
+	Seed = s;
+	Rng.seed(s);
+}
+
+bool parse_mode(const char* name, Mode& mode) {
+	constexpr std::array<std::string_view, 3> names{"chip8", "schip",
+	                                                 "xochip"};
+	const auto it = std::find(names.begin(), names.end(), name);
+	if (it == names.end()) { return false; }
+	mode = static_cast<Mode>(it - names.begin());
+	return true;
+}
 
-	// use current time as seed
-	std::srand(std::time(nullptr));
+bool parse_quirks(const char* name, Quirks& quirks) {
+	constexpr std::array<std::string_view, 5> names{"default", "vip", "chip48",
+	                                                 "schip", "xochip"};
+	const auto it = std::find(names.begin(), names.end(), name);
+	if (it == names.end()) { return false; }
+	quirks = static_cast<Quirks>(it - names.begin());
+	return true;
 }
 
-// Temp use of fstream.
-void Chip8::load_rom(const char* filename) {
-	std::ifstream rom(filename, std::ios::binary | std::ios::ate);
+// Selects the instruction set. Only XO-CHIP addresses past 4 KB.
+void Chip8::set_mode(Mode m) {
+	Variant  = m;
+	AddrMask = m == Mode::XOChip ? 0xFFFF : 0xFFF;
+	invalidate_code();
+}
+
+// Selects the quirk profile. Decoded code is dropped so the next run picks
+// up the profile's handlers.
+void Chip8::set_quirks(Quirks q) {
+	Quirk = q;
+	invalidate_code();
+}
 
-	if (rom.is_open()) {
-		std::streampos ssize = rom.tellg();
+// On error the machine is left as it was.
+LoadError Chip8::load_rom(const char* filename) {
+	Rom             rom;
+	const LoadError err = rom.open(filename, rom_limit(Variant));
+	if (err == LoadError::None) { load_rom(rom); }
+	return err;
+}
 
-		char* buffer = new char[ssize];
+void Chip8::load_rom(const Rom& rom) {
+	std::copy_n(rom.Data, rom.Size, &Memory[Rom::Base]);
+	RomHash = rom.Hash;
+	invalidate_code();
+}
 
-		rom.seekg(0, std::ios::beg);
-		rom.read(buffer, ssize);
-		rom.close();
+namespace {
+void op_decode(Chip8& c8, const Instr& /*unused*/);
 
-		for (auto i = 0; i != ssize; ++i) { Memory[0x200 + i] = buffer[i]; }
+// Unknown opcodes are skipped; a Tracer still records them.
+void op_unknown(Chip8& c8, const Instr& /*unused*/) { c8.PC += 2; }
 
-		delete[] buffer;
+// Calls f on each plane selected by FN01; just plane 0 before XO-CHIP.
+template <typename F>
+void each_plane(Chip8& c8, F f) {
+	for (uint8_t p = 0; p != 2; ++p) {
+		if ((c8.Planes >> p) & 1) { f(c8.Display[p]); }
 	}
 }
 
-void Chip8::emulate_cycle() {
-	// Fetch Opcode
-	OC = Memory[PC] << 8 | Memory[PC + 1];
+// Length of a taken skip: XO-CHIP also steps over F000 NNNN, its one
+// two-word instruction.
+template <bool Long>
+uint16_t skip(const Chip8& c8) {
+	if constexpr (Long) {
+		const uint16_t next = (c8.PC + 2) & c8.AddrMask;
+		if (c8.Memory[next] == 0xF0 &&
+		    c8.Memory[(next + 1) & c8.AddrMask] == 0x00) {
+			return 6;
+		}
+	}
+	return 4;
+}
 
-	const auto NNN = (OC & 0x0FFF);
-	const auto NN  = (OC & 0x00FF);
-	const auto N   = (OC & 0x000F);
-	const auto X   = ((OC & 0x0F00) >> 8);
-	const auto Y   = ((OC & 0x00F0) >> 4);
+void op_cls(Chip8& c8, const Instr& /*unused*/) {
+	// CLS: Clear the display
+	each_plane(c8, [](Chip8::Plane& d) { d.fill(0); });
+	c8.DirtyRows = ~0ULL;
+	c8.PC += 2;
+}
 
-	// Decode & Execute
-	switch (OC & 0xF000) {
-		case 0x0000:
-			switch (NN) {
-				case 0x00E0:
-					// CLS: Clear the display
-					LOG("CLS");
-					Display.fill(0);
-					PC += 2;
-					break;
-				case 0x00EE:
-					// RET: Return from a subroutine
-					LOG("RET");
-					PC = Stack[SP--];
-					break;
-				default: UNKNOWN_INS; break;
+void op_scd(Chip8& c8, const Instr& in) {
+	// SCD nibble: Scroll the display down n rows
+	const uint8_t h = c8.height();
+	each_plane(c8, [&](Chip8::Plane& d) {
+		for (uint8_t y = h; y-- != 0;) {
+			d[y]      = y >= in.N ? d[y - in.N] : 0;
+			d[64 + y] = y >= in.N ? d[64 + y - in.N] : 0;
+		}
+	});
+	c8.DirtyRows = ~0ULL;
+	c8.PC += 2;
+}
+
+void op_scu(Chip8& c8, const Instr& in) {
+	// SCU nibble: Scroll the display up n rows
+	const uint8_t h = c8.height();
+	each_plane(c8, [&](Chip8::Plane& d) {
+		for (uint8_t y = 0; y != h; ++y) {
+			d[y]      = y + in.N < h ? d[y + in.N] : 0;
+			d[64 + y] = y + in.N < h ? d[64 + y + in.N] : 0;
+		}
+	});
+	c8.DirtyRows = ~0ULL;
+	c8.PC += 2;
+}
+
+void op_scr(Chip8& c8, const Instr& /*unused*/) {
+	// SCR: Scroll the display right 4 pixels
+	const uint8_t h     = c8.height();
+	const bool    hires = c8.HiRes;
+	each_plane(c8, [&](Chip8::Plane& d) {
+		for (uint8_t y = 0; y != h; ++y) {
+			if (hires) { d[64 + y] = d[64 + y] >> 4 | d[y] << 60; }
+			d[y] >>= 4;
+		}
+	});
+	c8.DirtyRows = ~0ULL;
+	c8.PC += 2;
+}
+
+void op_scl(Chip8& c8, const Instr& /*unused*/) {
+	// SCL: Scroll the display left 4 pixels
+	const uint8_t h     = c8.height();
+	const bool    hires = c8.HiRes;
+	each_plane(c8, [&](Chip8::Plane& d) {
+		for (uint8_t y = 0; y != h; ++y) {
+			d[y] <<= 4;
+			if (hires) {
+				d[y] |= d[64 + y] >> 60;
+				d[64 + y] <<= 4;
 			}
-			break;
-		case 0x1000:
-			// JP addr: Jump to location nnn
-			LOG("JP " << NNN);
-			PC = NNN;
-			break;
-		case 0x2000:
-			// CALL addr: Call subroutine at nnn
-			LOG("CALL " << NNN);
-			Stack[++SP] = PC + 2;
-			PC          = NNN;
-			break;
-		case 0x3000:
-			// SE Vx, byte: Skip next instruction if Vx = nn
-			LOG("SE V" << X << ", " << NN);
-			PC += (V[X] == NN) ? 4 : 2;
-			break;
-		case 0x4000:
-			// SNE Vx, byte: Skip next instruction if Vx != nn
-			LOG("SNE V" << X << ", " << NN);
-			PC += (V[X] != NN) ? 4 : 2;
-			break;
-		case 0x5000:
-			// SE Vx, Vy: Skip next instruction if Vx = Vy
-			LOG("SE V" << X << ", V" << Y);
-			PC += (V[X] == V[Y]) ? 4 : 2;
-			break;
-		case 0x6000:
-			// LD Vx, byte: Set Vx = nn
-			LOG("LD V" << X << ", " << NN);
-			V[X] = NN;
-			PC += 2;
-			break;
-		case 0x7000:
-			// ADD Vx, byte: Set Vx = Vx + nn
-			LOG("ADD V" << X << ", " << NN);
-			V[X] += NN;
-			PC += 2;
-			break;
-		case 0x8000:
-			switch (N) {
-				case 0x0:
-					// LD Vx, Vy: Set Vx = Vy
-					LOG("LD V" << X << ", V" << Y);
-					V[X] = V[Y];
-					break;
-				case 0x1:
-					// OR Vx, Vy: Set Vx = Vx OR Vy
-					LOG("OR V" << X << ", V" << Y);
-					V[X] |= V[Y];
-					break;
-				case 0x2:
-					// AND Vx, Vy: Set Vx = Vx AND Vy
-					LOG("AND V" << X << ", V" << Y);
-					V[X] &= V[Y];
-					break;
-				case 0x3:
-					// XOR Vx, Vy: Set Vx = Vx XOR Vy
-					LOG("XOR V" << X << ", V" << Y);
-					V[X] ^= V[Y];
-					break;
-				case 0x4:
-					// ADD Vx, Vy: Set Vx = Vx + Vy, VF = carry
-					LOG("ADD V" << X << ", V" << Y << " With Carry");
-					V[0xF] = (V[X] + V[Y]) > 255 ? 1 : 0;
-					V[X] += V[Y];
-					break;
-				case 0x5:
-					// SUB Vx, Vy: Set Vx = Vx - Vy, VF = NOT Borrow
-					LOG("SUB V" << X << ", V" << Y << " With Borrow");
-					V[0xF] = V[X] > V[Y];
-					V[X] -= V[Y];
-					break;
-				case 0x6:
-					// SHR Vx {, Vy}: Set Vx = SHR 1
-					LOG("SHR V" << X << ", V" << Y);
-					V[0xF] = V[X] & 0x1;
-					V[X] >>= 1;
-					break;
-				case 0x7:
-					// SUBN Vx, Vy: Set Vx = Vy - Vx, Set VF = NOT Borrow
-					LOG("SUBN V" << X << ", V" << Y);
-					V[0xF] = V[Y] > V[X];
-					V[X]   = V[Y] - V[X];
-					break;
-				case 0xE:
-					// SHL Vx {, Vy}: Set Vx = Vx SHL 1
-					LOG("SHL V" << X << ", V" << Y);
-					V[0xF] = V[X] >> 7;
-					V[X] <<= 1;
-					break;
-				default: UNKNOWN_INS; break;
+		}
+	});
+	c8.DirtyRows = ~0ULL;
+	c8.PC += 2;
+}
+
+void op_exit(Chip8& c8, const Instr& /*unused*/) {
+	// EXIT: Stop the interpreter. The PC stays here.
+	c8.Idle = true;
+}
+
+template <bool High>
+void op_res(Chip8& c8, const Instr& /*unused*/) {
+	// LOW / HIGH: Switch to 64x32 / 128x64 and clear the display
+	c8.HiRes = High;
+	c8.Display.fill({});
+	c8.DirtyRows = ~0ULL;
+	c8.PC += 2;
+}
+
+void op_ret(Chip8& c8, const Instr& /*unused*/) {
+	// RET: Return from a subroutine
+	c8.PC = c8.Stack[c8.SP--];
+}
+
+void op_jp(Chip8& c8, const Instr& in) {
+	// JP addr: Jump to location nnn
+	const uint16_t pc = c8.PC & c8.AddrMask;
+	if (pc == in.NNN || ((pc - 4) & c8.AddrMask) == in.NNN) { c8.Idle = true; }
+	c8.PC = in.NNN;
+}
+
+void op_call(Chip8& c8, const Instr& in) {
+	// CALL addr: Call subroutine at nnn
+	c8.Stack[++c8.SP] = c8.PC + 2;
+	c8.PC             = in.NNN;
+}
+
+template <bool Long>
+void op_se_byte(Chip8& c8, const Instr& in) {
+	// SE Vx, byte: Skip next instruction if Vx = nn
+	c8.PC += (c8.V[in.X] == in.NN) ? skip<Long>(c8) : 2;
+}
+
+template <bool Long>
+void op_sne_byte(Chip8& c8, const Instr& in) {
+	// SNE Vx, byte: Skip next instruction if Vx != nn
+	c8.PC += (c8.V[in.X] != in.NN) ? skip<Long>(c8) : 2;
+}
+
+template <bool Long>
+void op_se_reg(Chip8& c8, const Instr& in) {
+	// SE Vx, Vy: Skip next instruction if Vx = Vy
+	c8.PC += (c8.V[in.X] == c8.V[in.Y]) ? skip<Long>(c8) : 2;
+}
+
+void op_save_range(Chip8& c8, const Instr& in) {
+	// SAVE Vx - Vy: Store Vx through Vy, in either order, at I onwards
+	const int8_t step = in.X <= in.Y ? 1 : -1;
+	uint16_t     addr = c8.I;
+	for (uint8_t r = in.X;; r += step) {
+		c8.write_mem(addr++, c8.V[r]);
+		if (r == in.Y) { break; }
+	}
+	c8.PC += 2;
+}
+
+void op_load_range(Chip8& c8, const Instr& in) {
+	// LOAD Vx - Vy: Read Vx through Vy, in either order, from I onwards
+	const int8_t step = in.X <= in.Y ? 1 : -1;
+	uint16_t     addr = c8.I;
+	for (uint8_t r = in.X;; r += step) {
+		c8.V[r] = c8.Memory[addr++ & c8.AddrMask];
+		if (r == in.Y) { break; }
+	}
+	c8.PC += 2;
+}
+
+void op_ld_byte(Chip8& c8, const Instr& in) {
+	// LD Vx, byte: Set Vx = nn
+	c8.V[in.X] = in.NN;
+	c8.PC += 2;
+}
+
+void op_add_byte(Chip8& c8, const Instr& in) {
+	// ADD Vx, byte: Set Vx = Vx + nn
+	c8.V[in.X] += in.NN;
+	c8.PC += 2;
+}
+
+void op_ld_reg(Chip8& c8, const Instr& in) {
+	// LD Vx, Vy: Set Vx = Vy
+	c8.V[in.X] = c8.V[in.Y];
+	c8.PC += 2;
+}
+
+template <uint8_t Q>
+void op_or(Chip8& c8, const Instr& in) {
+	// OR Vx, Vy: Set Vx = Vx OR Vy
+	c8.V[in.X] |= c8.V[in.Y];
+	if constexpr ((Q & VfReset) != 0) { c8.V[0xF] = 0; }
+	c8.PC += 2;
+}
+
+template <uint8_t Q>
+void op_and(Chip8& c8, const Instr& in) {
+	// AND Vx, Vy: Set Vx = Vx AND Vy
+	c8.V[in.X] &= c8.V[in.Y];
+	if constexpr ((Q & VfReset) != 0) { c8.V[0xF] = 0; }
+	c8.PC += 2;
+}
+
+template <uint8_t Q>
+void op_xor(Chip8& c8, const Instr& in) {
+	// XOR Vx, Vy: Set Vx = Vx XOR Vy
+	c8.V[in.X] ^= c8.V[in.Y];
+	if constexpr ((Q & VfReset) != 0) { c8.V[0xF] = 0; }
+	c8.PC += 2;
+}
+
+void op_add_reg(Chip8& c8, const Instr& in) {
+	// ADD Vx, Vy: Set Vx = Vx + Vy, VF = carry
+	c8.V[0xF] = (c8.V[in.X] + c8.V[in.Y]) > 255 ? 1 : 0;
+	c8.V[in.X] += c8.V[in.Y];
+	c8.PC += 2;
+}
+
+void op_sub(Chip8& c8, const Instr& in) {
+	// SUB Vx, Vy: Set Vx = Vx - Vy, VF = NOT Borrow
+	c8.V[0xF] = c8.V[in.X] > c8.V[in.Y];
+	c8.V[in.X] -= c8.V[in.Y];
+	c8.PC += 2;
+}
+
+template <uint8_t Q>
+void op_shr(Chip8& c8, const Instr& in) {
+	// SHR Vx {, Vy}: Set Vx = SHR 1
+	const uint8_t src = c8.V[(Q & ShiftVy) != 0 ? in.Y : in.X];
+	c8.V[0xF]         = src & 0x1;
+	c8.V[in.X]        = src >> 1;
+	c8.PC += 2;
+}
+
+void op_subn(Chip8& c8, const Instr& in) {
+	// SUBN Vx, Vy: Set Vx = Vy - Vx, Set VF = NOT Borrow
+	c8.V[0xF]  = c8.V[in.Y] > c8.V[in.X];
+	c8.V[in.X] = c8.V[in.Y] - c8.V[in.X];
+	c8.PC += 2;
+}
+
+template <uint8_t Q>
+void op_shl(Chip8& c8, const Instr& in) {
+	// SHL Vx {, Vy}: Set Vx = Vx SHL 1
+	const uint8_t src = c8.V[(Q & ShiftVy) != 0 ? in.Y : in.X];
+	c8.V[0xF]         = src >> 7;
+	c8.V[in.X]        = src << 1;
+	c8.PC += 2;
+}
+
+template <bool Long>
+void op_sne_reg(Chip8& c8, const Instr& in) {
+	// SNE Vx, Vy: Skip next instruction if Vx != Vy
+	c8.PC += (c8.V[in.X] != c8.V[in.Y]) ? skip<Long>(c8) : 2;
+}
+
+void op_ld_i(Chip8& c8, const Instr& in) {
+	// LD I, addr: Set I = nnn
+	c8.I = in.NNN;
+	c8.PC += 2;
+}
+
+template <uint8_t Q>
+void op_jp_v0(Chip8& c8, const Instr& in) {
+	// JP V0, addr: Jump to location nnn + V0 (xnn + Vx with JumpVx)
+	c8.PC = in.NNN + c8.V[(Q & JumpVx) != 0 ? in.X : 0x0];
+}
+
+void op_rnd(Chip8& c8, const Instr& in) {
+	// RND Vx, byte: Set Vx = random byte AND nn
+	c8.V[in.X] = c8.Rng.next() & in.NN;
+	c8.PC += 2;
+}
+
+uint64_t rotr(uint64_t v, uint8_t n) {
+	return n == 0 ? v : v >> n | v << (64 - n);
+}
+
+// DirtyRows bits for count rows from first on, wrapping at height h.
+uint64_t row_span(uint8_t first, uint8_t count, uint8_t h) {
+	const uint64_t rows = (uint64_t{1} << count) - 1;
+	if (h == 64) { return rotr(rows, (64 - first) % 64); }
+	const uint64_t span = rows << first;
+	return (span | span >> 32) & 0xFFFFFFFF;
+}
+
+template <uint8_t Q>
+void op_drw(Chip8& c8, const Instr& in) {
+	// DRW x, y, nibble: Display n-byte sprite starting at memory location I
+	// at(Vx, Vy), Set VF = collision. Sprites clip at the right and bottom,
+	// or wrap around with the Wrap quirk.
+	constexpr bool wrap = (Q & Wrap) != 0;
+	const uint8_t  xPos = c8.V[in.X] % 64;
+	const uint8_t  yPos = c8.V[in.Y] % 32;
+	const uint8_t  rows = wrap ? in.N : std::min<uint8_t>(in.N, 32 - yPos);
+
+	c8.DirtyRows |= wrap ? row_span(yPos, rows, 32)
+	                     : ((uint64_t{1} << rows) - 1) << yPos;
+	c8.V[0xF] = 0;
+	for (uint8_t row = 0; row != rows; ++row) {
+		const uint8_t  y      = wrap ? (yPos + row) % 32 : yPos + row;
+		const uint64_t bits   = uint64_t{c8.Memory[(c8.I + row) & 0xFFF]} << 56;
+		const uint64_t sprite = wrap ? rotr(bits, xPos) : bits >> xPos;
+		uint64_t&      line   = c8.Display[0][y];
+
+		if ((line & sprite) != 0) { c8.V[0xF] = 1; }
+		line ^= sprite;
+	}
+	c8.PC += 2;
+}
+
+template <uint8_t Q>
+void op_drw_ext(Chip8& c8, const Instr& in) {
+	// DRW x, y, nibble: As above in either resolution, 16x16 when n = 0, once
+	// per selected plane with each plane's rows following the last. A row is
+	// at most two word XORs whatever the resolution.
+	constexpr bool wrap  = (Q & Wrap) != 0;
+	const uint8_t  h     = c8.height();
+	const uint8_t  xPos  = c8.V[in.X] & (c8.width() - 1);
+	const uint8_t  yPos  = c8.V[in.Y] & (h - 1);
+	const bool     wide  = in.N == 0;
+	const uint8_t  n     = wide ? 16 : in.N;
+	const uint8_t  rows  = wrap ? n : std::min<uint8_t>(n, h - yPos);
+	const bool     hires = c8.HiRes;
+	const uint16_t mask  = c8.AddrMask;
+	uint16_t       src   = c8.I;
+
+	c8.DirtyRows |= wrap ? row_span(yPos, rows, h)
+	                     : ((uint64_t{1} << rows) - 1) << yPos;
+	c8.V[0xF] = 0;
+	each_plane(c8, [&](Chip8::Plane& d) {
+		for (uint8_t row = 0; row != rows; ++row) {
+			const uint64_t sprite =
+			    wide ? uint64_t{c8.Memory[(src + 2 * row) & mask]} << 56 |
+			               uint64_t{c8.Memory[(src + 2 * row + 1) & mask]}
+			                   << 48
+			         : uint64_t{c8.Memory[(src + row) & mask]} << 56;
+			uint64_t left  = 0;
+			uint64_t right = 0;
+			if (!hires) {
+				left = wrap ? rotr(sprite, xPos) : sprite >> xPos;
+			} else if (xPos < 64) {
+				left = sprite >> xPos;
+				if (xPos != 0) { right = sprite << (64 - xPos); }
+			} else {
+				right = sprite >> (xPos - 64);
+				if (wrap && xPos != 64) { left = sprite << (128 - xPos); }
 			}
-			PC += 2;
-			break;
-		case 0x9000:
-			// SNE Vx, Vy: Skip next instruction if Vx != Vy
-			LOG("SNE V" << X << ", V" << Y);
-			PC += (V[X] != V[Y]) ? 4 : 2;
-			break;
-		case 0xA000:
-			// LD I, addr: Set I = nnn
-			LOG("LD I, " << NNN);
-			I = NNN;
-			PC += 2;
-			break;
-		case 0xB000:
-			// JP V0, addr: Jump to location nnn + V0
-			LOG("JP V0 + " << NNN);
-			PC = NNN + V[0x0];
-			break;
-		case 0xC000:
-			// RND Vx, byte: Set Vx = random byte AND nn
-			LOG("RND V" << X << ", " << NN);
-			V[X] = (rand() % 256) & NN;
-			PC += 2;
-			break;
-		case 0xD000:
-			// DRW x, y, nibble: Display n-byte sprite starting at memory
-			// location I at(Vx, Vy), Set VF = collision
-			LOG("DRW " << X << ", " << Y << ", " << N);
-			{
-				uint8_t xPos = V[X] % 64;
-				uint8_t yPos = V[Y] % 32;
 
-				V[0xF] = 0;
-				for (uint8_t row = 0; row != N; ++row) {
-					uint8_t spriteByte = Memory[I + row];
+			const uint8_t y = (yPos + row) & (h - 1);
+			uint64_t&     l = d[y];
+			uint64_t&     r = d[64 + y];
+			if (((l & left) | (r & right)) != 0) { c8.V[0xF] = 1; }
+			l ^= left;
+			r ^= right;
+		}
+		src += wide ? 2 * n : n;
+	});
+	c8.PC += 2;
+}
 
-					for (uint8_t col = 0; col != 8; ++col) {
-						uint8_t spritePixel = (spriteByte >> (7 - col)) & 0x1;
+template <bool Long>
+void op_skp(Chip8& c8, const Instr& in) {
+	// SKP Vx: Skip next instruction if key with the value of Vx is pressed
+	c8.PC += (c8.Key[c8.V[in.X]]) ? skip<Long>(c8) : 2;
+}
 
-						uint8_t* pixel =
-						    &Display[((yPos + row) * 64) + (xPos + col)];
+template <bool Long>
+void op_sknp(Chip8& c8, const Instr& in) {
+	// SKNP Vx: Skip next instruction if key with the value of Vx is NOT
+	// pressed
+	c8.PC += (!c8.Key[c8.V[in.X]]) ? skip<Long>(c8) : 2;
+}
 
-						if (spritePixel == 1 && *pixel == 1) { V[0xF] = 1; }
+void op_ld_vx_dt(Chip8& c8, const Instr& in) {
+	// LD Vx, DT: Set Vx = Delay Timer value
+	c8.V[in.X] = c8.DT;
+	c8.PC += 2;
+}
 
-						*pixel ^= spritePixel;
+void op_ld_vx_k(Chip8& c8, const Instr& in) {
+	// LD Vx, K: Wait for a key press, store value of the key in Vx
+	const uint16_t keys = c8.key_mask();
+	if (keys == 0) {
+		c8.Idle = true;
+		return;
+	}
+	c8.V[in.X] = 31 - __builtin_clz(keys);  // Highest key down
+	c8.PC += 2;
+}
+
+void op_ld_dt_vx(Chip8& c8, const Instr& in) {
+	// LD DT, Vx: Set Delay Timer = Vx
+	c8.DT = c8.V[in.X];
+	c8.PC += 2;
+}
+
+void op_ld_st_vx(Chip8& c8, const Instr& in) {
+	// LD ST, Vx: Set Sound Timer = Vx
+	c8.ST = c8.V[in.X];
+	c8.PC += 2;
+}
+
+void op_add_i_vx(Chip8& c8, const Instr& in) {
+	// ADD I, Vx: Set I = I + Vx
+	c8.I += c8.V[in.X];
+	c8.PC += 2;
+}
+
+void op_ld_f_vx(Chip8& c8, const Instr& in) {
+	// LD F, Vx: Set I = location of sprite for digit Vx
+	c8.I = 5 * c8.V[in.X];
+	c8.PC += 2;
+}
+
+void op_ld_b_vx(Chip8& c8, const Instr& in) {
+	// LD B, Vx: Store BCD representation of Vx in memory locations I, I + 1,
+	// and I + 2
+	const uint8_t vx = c8.V[in.X];
+	c8.write_mem(c8.I, (vx % 1000) / 100);
+	c8.write_mem(c8.I + 1, (vx % 100) / 10);
+	c8.write_mem(c8.I + 2, vx % 10);
+	c8.PC += 2;
+}
+
+// FX55 and FX65 leave I alone unless the profile says otherwise.
+template <uint8_t Q>
+void advance_i(Chip8& c8, const Instr& in) {
+	if constexpr ((Q & IncI) != 0) { c8.I += in.X + 1; }
+	if constexpr ((Q & IncIX) != 0) { c8.I += in.X; }
+}
+
+template <uint8_t Q>
+void op_ld_i_vx(Chip8& c8, const Instr& in) {
+	// LD {I}, Vx: Store registers V0 through Vx in memory starting at
+	// location I
+	for (uint8_t i = 0; i <= in.X; ++i) { c8.write_mem(c8.I + i, c8.V[i]); }
+	advance_i<Q>(c8, in);
+	c8.PC += 2;
+}
+
+template <uint8_t Q>
+void op_ld_vx_i(Chip8& c8, const Instr& in) {
+	// LD Vx, {I}: Read registers V0 through Vx from memory starting at
+	// location I
+	for (uint8_t i = 0; i <= in.X; ++i) {
+		c8.V[i] = c8.Memory[(c8.I + i) & c8.AddrMask];
+	}
+	advance_i<Q>(c8, in);
+	c8.PC += 2;
+}
+
+void op_ld_hf_vx(Chip8& c8, const Instr& in) {
+	// LD HF, Vx: Set I = location of large sprite for digit Vx
+	c8.I = BigFont + 10 * (c8.V[in.X] & 0xF);
+	c8.PC += 2;
+}
+
+void op_ld_r_vx(Chip8& c8, const Instr& in) {
+	// LD R, Vx: Store V0 through Vx in the user flags
+	std::copy_n(c8.V.begin(), in.X + 1, c8.Flags.begin());
+	c8.PC += 2;
+}
+
+void op_ld_vx_r(Chip8& c8, const Instr& in) {
+	// LD Vx, R: Read V0 through Vx from the user flags
+	std::copy_n(c8.Flags.begin(), in.X + 1, c8.V.begin());
+	c8.PC += 2;
+}
+
+void op_ld_i_long(Chip8& c8, const Instr& /*unused*/) {
+	// LD I, long nnnn: Set I = the word after this instruction
+	const uint16_t next = (c8.PC + 2) & c8.AddrMask;
+	c8.I = c8.Memory[next] << 8 | c8.Memory[(next + 1) & c8.AddrMask];
+	c8.PC += 4;
+}
+
+void op_plane(Chip8& c8, const Instr& in) {
+	// PLANE n: Select the bitplanes DRW, CLS and the scrolls act on
+	c8.Planes = in.X & 0x3;
+	c8.PC += 2;
+}
+
+void op_audio(Chip8& c8, const Instr& /*unused*/) {
+	// AUDIO: Load the 16-byte audio pattern from I
+	for (uint8_t i = 0; i != 16; ++i) {
+		c8.Pattern[i] = c8.Memory[(c8.I + i) & c8.AddrMask];
+	}
+	c8.PC += 2;
+}
+
+void op_pitch(Chip8& c8, const Instr& in) {
+	// PITCH Vx: Set the audio pattern playback rate
+	c8.Pitch = c8.V[in.X];
+	c8.PC += 2;
+}
+
+// Placeholder handler for addresses not decoded yet: decodes in place, then
+// runs the real handler.
+void op_decode(Chip8& c8, const Instr& /*unused*/) {
+	const uint16_t pc = c8.PC & 0xFFF;
+	const uint16_t op = c8.Memory[pc] << 8 | c8.Memory[(pc + 1) & c8.AddrMask];
+	Instr&         in = c8.Decoded[pc];
+
+	in    = Chip8::decode(op, c8.Variant, c8.Quirk);
+	c8.OC = in.OC;
+	in.Fn(c8, in);
+}
+
+// The decoder for one quirk profile: handlers the profile affects are
+// instantiated with its flags.
+template <uint8_t Q>
+Instr decode_as(uint16_t opcode, Mode mode) {
+	const bool schip = mode != Mode::Chip8;
+	const bool xo    = mode == Mode::XOChip;
+
+	Instr in;
+	in.OC  = opcode;
+	in.NNN = (opcode & 0x0FFF);
+	in.NN  = (opcode & 0x00FF);
+	in.N   = (opcode & 0x000F);
+	in.X   = ((opcode & 0x0F00) >> 8);
+	in.Y   = ((opcode & 0x00F0) >> 4);
+
+	switch (opcode & 0xF000) {
+		case 0x0000:
+			switch (in.NN) {
+				case 0xE0: in.Fn = op_cls; break;
+				case 0xEE: in.Fn = op_ret; break;
+				case 0xFB: in.Fn = schip ? op_scr : op_unknown; break;
+				case 0xFC: in.Fn = schip ? op_scl : op_unknown; break;
+				case 0xFD: in.Fn = schip ? op_exit : op_unknown; break;
+				case 0xFE: in.Fn = schip ? op_res<false> : op_unknown; break;
+				case 0xFF: in.Fn = schip ? op_res<true> : op_unknown; break;
+				default:
+					if (schip && (in.NN & 0xF0) == 0xC0) {
+						in.Fn = op_scd;
+					} else if (xo && (in.NN & 0xF0) == 0xD0) {
+						in.Fn = op_scu;
+					} else {
+						in.Fn = op_unknown;
 					}
-				}
+					break;
 			}
-			PC += 2;
 			break;
-		case 0xE000:
-			switch (NN) {
-				case 0x9E:
-					// SKP Vx: Skip next instruction if key with the value of Vx
-					// is pressed
-					LOG("SKP V" << X);
-					PC += (Key[V[X]]) ? 4 : 2;
-					break;
-				case 0xA1:
-					// SKNP Vx: Skip next instruction if key with the value of
-					// Vx is NOT pressed
-					LOG("SKNP V" << X);
-					PC += (!Key[V[X]]) ? 4 : 2;
+		case 0x1000: in.Fn = op_jp; break;
+		case 0x2000: in.Fn = op_call; break;
+		case 0x3000: in.Fn = xo ? op_se_byte<true> : op_se_byte<false>; break;
+		case 0x4000: in.Fn = xo ? op_sne_byte<true> : op_sne_byte<false>; break;
+		case 0x5000:
+			switch (xo ? in.N : 0) {
+				case 0x2: in.Fn = op_save_range; break;
+				case 0x3: in.Fn = op_load_range; break;
+				default:
+					in.Fn = xo ? op_se_reg<true> : op_se_reg<false>;
 					break;
-				default: UNKNOWN_INS; break;
+			}
+			break;
+		case 0x6000: in.Fn = op_ld_byte; break;
+		case 0x7000: in.Fn = op_add_byte; break;
+		case 0x8000:
+			switch (in.N) {
+				case 0x0: in.Fn = op_ld_reg; break;
+				case 0x1: in.Fn = op_or<Q>; break;
+				case 0x2: in.Fn = op_and<Q>; break;
+				case 0x3: in.Fn = op_xor<Q>; break;
+				case 0x4: in.Fn = op_add_reg; break;
+				case 0x5: in.Fn = op_sub; break;
+				case 0x6: in.Fn = op_shr<Q>; break;
+				case 0x7: in.Fn = op_subn; break;
+				case 0xE: in.Fn = op_shl<Q>; break;
+				default: in.Fn = op_unknown; break;
+			}
+			break;
+		case 0x9000: in.Fn = xo ? op_sne_reg<true> : op_sne_reg<false>; break;
+		case 0xA000: in.Fn = op_ld_i; break;
+		case 0xB000: in.Fn = op_jp_v0<Q>; break;
+		case 0xC000: in.Fn = op_rnd; break;
+		case 0xD000: in.Fn = schip ? op_drw_ext<Q> : op_drw<Q>; break;
+		case 0xE000:
+			switch (in.NN) {
+				case 0x9E: in.Fn = xo ? op_skp<true> : op_skp<false>; break;
+				case 0xA1: in.Fn = xo ? op_sknp<true> : op_sknp<false>; break;
+				default: in.Fn = op_unknown; break;
 			}
 			break;
 		case 0xF000:
-			switch (NN) {
-				case 0x07:
-					// LD Vx, DT: Set Vx = Delay Timer value
-					LOG("LD V" << X << ", DT: " << DT);
-					V[X] = DT;
-					break;
-				case 0x0A:
-					// LD Vx, K: Wait for a key press, store value of the key in
-					// Vx
-					LOG("LD V" << X << " K: Wait for a key press");
-					for (uint8_t i = 0; i != 16; ++i) {
-						if (Key[i] == 1) { V[X] = i; }
-					}
-					PC -= 2;
-					break;
-				case 0x15:
-					// LD DT, Vx: Set Delay Timer = Vx
-					LOG("LD DT: " << DT << ", V" << X);
-					DT = V[X];
-					break;
-				case 0x18:
-					// LD ST, Vx: Set Sound Timer = Vx
-					LOG("LD ST: " << ST << ", V" << X);
-					ST = V[X];
-					break;
-				case 0x1E:
-					// ADD I, Vx: Set I = I + Vx
-					LOG("ADD I, V" << X);
-					I += V[X];
+			switch (in.NN) {
+				case 0x00:
+					in.Fn = xo && in.X == 0 ? op_ld_i_long : op_unknown;
 					break;
-				case 0x29:
-					// LD F, Vx: Set I = location of sprite for digit Vx
-					LOG("LD F, V" << X);
-					I = 5 * V[X];
+				case 0x01: in.Fn = xo ? op_plane : op_unknown; break;
+				case 0x02:
+					in.Fn = xo && in.X == 0 ? op_audio : op_unknown;
 					break;
-				case 0x33:
-					// LD B, Vx: Store BCD representation of Vx in memory
-					// locations I, I + 1, and I + 2
-					LOG("LD B, V" << X << "Store BCD");
-					Memory[I]     = (V[X] % 1000) / 100;
-					Memory[I + 1] = (V[X] % 100) / 10;
-					Memory[I + 2] = V[X] % 10;
-					break;
-				case 0x55:
-					// LD {I}, Vx: Store registers V0 through Vx in memory
-					// starting at location I
-					LOG("LD {I}, "
-					    << "Store Regs V0 through V" << X);
-					for (uint8_t i = 0; i <= X; ++i) Memory[I + i] = V[i];
-					break;
-				case 0x65:
-					// LD Vx, {I}: Read registers V0 through Vx from memory
-					// starting at location I
-					LOG("LD Read Regs V0 through V" << X << ", {I}");
-					for (uint8_t i = 0; i <= X; ++i) V[i] = Memory[I + i];
-					break;
-				default: UNKNOWN_INS; break;
+				case 0x07: in.Fn = op_ld_vx_dt; break;
+				case 0x0A: in.Fn = op_ld_vx_k; break;
+				case 0x15: in.Fn = op_ld_dt_vx; break;
+				case 0x18: in.Fn = op_ld_st_vx; break;
+				case 0x1E: in.Fn = op_add_i_vx; break;
+				case 0x29: in.Fn = op_ld_f_vx; break;
+				case 0x30: in.Fn = schip ? op_ld_hf_vx : op_unknown; break;
+				case 0x33: in.Fn = op_ld_b_vx; break;
+				case 0x3A: in.Fn = xo ? op_pitch : op_unknown; break;
+				case 0x55: in.Fn = op_ld_i_vx<Q>; break;
+				case 0x65: in.Fn = op_ld_vx_i<Q>; break;
+				case 0x75: in.Fn = schip ? op_ld_r_vx : op_unknown; break;
+				case 0x85: in.Fn = schip ? op_ld_vx_r : op_unknown; break;
+				default: in.Fn = op_unknown; break;
 			}
-			PC += 2;
 			break;
-		default: UNKNOWN_INS; break;
+		default: in.Fn = op_unknown; break;
 	}
-	// Tick
+	return in;
+}
+}  // namespace
+
+Instr Chip8::decode(uint16_t opcode, Mode mode, Quirks quirks) {
+	switch (quirks) {
+		case Quirks::VIP:
+			return decode_as<quirk_flags(Quirks::VIP)>(opcode, mode);
+		case Quirks::CHIP48:
+			return decode_as<quirk_flags(Quirks::CHIP48)>(opcode, mode);
+		case Quirks::SChip:
+			return decode_as<quirk_flags(Quirks::SChip)>(opcode, mode);
+		case Quirks::XOChip:
+			return decode_as<quirk_flags(Quirks::XOChip)>(opcode, mode);
+		default: return decode_as<0>(opcode, mode);
+	}
+}
+
+bool Chip8::known(uint16_t opcode, Mode mode) {
+	return decode(opcode, mode).Fn != op_unknown;
+}
+
+void Chip8::emulate_cycle() {
+	const uint16_t pc = PC & AddrMask;
+	Instr          far;  // XO-CHIP code outside the decode cache
+	const Instr&   in =
+	    pc < CodeSize
+	          ? Decoded[pc]
+	          : (far = decode(Memory[pc] << 8 | Memory[(pc + 1) & AddrMask],
+	                          Variant, Quirk));
+	OC = in.OC;
+	++Cycles;
+	if (Trace != nullptr) {
+		const uint16_t pc     = PC;
+		const auto     before = V;
+		execute(in);
+		Trace->record(*this, pc, before);
+		return;
+	}
+	execute(in);
+}
+
+void Chip8::execute(const Instr& in) {
+#ifdef Profile
+	if (Prof != nullptr) {
+		Prof->run(*this, in);
+		return;
+	}
+#endif
+	in.Fn(*this, in);
+}
+
+// All stores to Memory go through here so stale decodes never run. The
+// instruction starting one byte earlier also covers addr.
+void Chip8::write_mem(uint16_t addr, uint8_t value) {
+	addr &= AddrMask;
+	Memory[addr] = value;
+	DirtyPages[addr / PageSize / 64] |= 1ULL << (addr / PageSize % 64);
+	if (addr > CodeSize) { return; }
+
+	Instr& at     = Decoded[addr & 0xFFF];
+	Instr& before = Decoded[(addr - 1) & 0xFFF];
+	if (at.Fn != op_decode || before.Fn != op_decode) {
+		at.Fn     = op_decode;
+		before.Fn = op_decode;
+		++CodeGen;
+	}
+}
+
+// For when Memory is replaced wholesale (reset, ROM and state loads).
+void Chip8::invalidate_code() {
+	for (auto& in : Decoded) { in.Fn = op_decode; }
+	++CodeGen;
+	DirtyPages.fill(~0ULL);
+}
+
+// Makes the current Memory the image reset() returns to. Call it right
+// after load_rom.
+void Chip8::capture_pristine() {
+	Image = std::make_shared<Pristine>(Pristine{Memory, RomHash});
+	DirtyPages.fill(0);
+}
+
+// Shares an image captured on another machine. Memory is unrelated to it
+// until the next reset().
+void Chip8::use_pristine(std::shared_ptr<const Pristine> image) {
+	Image = std::move(image);
+	DirtyPages.fill(~0ULL);
+}
+
+// Power-on state with Memory back to Image. Only pages stored to since the
+// last reset are copied, and the decode cache survives everywhere else, so
+// restarting the same ROM is a few hundred bytes of work. Without an image
+// this is init_or_reset().
+void Chip8::reset() {
+	if (!Image) {
+		init_or_reset();
+		return;
+	}
+
+	power_on(*this);
+	RomHash = Image->RomHash;
+
+	for (size_t w = 0; w != DirtyPages.size(); ++w) {
+		for (uint64_t pages = DirtyPages[w]; pages != 0; pages &= pages - 1) {
+			const size_t base = (w * 64 + __builtin_ctzll(pages)) * PageSize;
+			std::copy_n(&Image->Memory[base], PageSize, &Memory[base]);
+			if (base > CodeSize) { continue; }
+			for (size_t a = base; a != std::min(base + PageSize, CodeSize);
+			     ++a) {
+				Decoded[a].Fn = op_decode;
+			}
+			// Straddles into the page
+			Decoded[(base - 1) & 0xFFF].Fn = op_decode;
+			++CodeGen;
+		}
+	}
+	DirtyPages.fill(0);
+
+	Rng.seed(Seed);
+}
+
+// Decoded entry for addr, filling the cache if needed.
+const Instr& Chip8::decoded(uint16_t addr) {
+	addr &= 0xFFF;
+	Instr& in = Decoded[addr];
+	if (in.Fn == op_decode) {
+		in = decode(Memory[addr] << 8 | Memory[(addr + 1) & AddrMask],
+		            Variant, Quirk);
+	}
+	return in;
+}
+
+namespace {
+constexpr std::array<uint8_t, 4> StateMagic{'C', '8', 'S', 6};
+
+// Where load_state finds the fields it checks before touching anything.
+constexpr size_t SPAt    = 4 + 1;
+constexpr size_t HashAt  = 4 + 3 + 6 + 8 + 8;
+constexpr size_t ModeAt  = HashAt + 8 + 16 + 16 + 32;
+constexpr size_t HiResAt = ModeAt + 2;
+
+// Bytes a state for mode takes; only memory up to AddrMask is kept.
+size_t state_bytes(uint8_t mode) {
+	return Chip8::CoreSize +
+	       (mode == uint8_t(Mode::XOChip) ? Chip8::MemorySize : 0x1000);
+}
+
+template <typename T>
+uint8_t* put(uint8_t* p, T v) {
+	for (size_t i = 0; i != sizeof(T); ++i) { *p++ = (v >> (8 * i)) & 0xFF; }
+	return p;
+}
+
+template <typename T>
+const uint8_t* get(const uint8_t* p, T& v) {
+	v = 0;
+	for (size_t i = 0; i != sizeof(T); ++i) { v |= T(*p++) << (8 * i); }
+	return p;
+}
+}  // namespace
+
+void Chip8::save_state(State& out) const {
+	uint8_t* p = std::copy(StateMagic.begin(), StateMagic.end(), out.begin());
+
+	p = put(put(put(p, DT), SP), ST);
+	p = put(put(put(p, I), OC), PC);
+	p = put(put(p, Seed), Rng.State);
+	p = put(put(p, Cycles), RomHash);
+	p = std::copy(Key.begin(), Key.end(), p);
+	p = std::copy(V.begin(), V.end(), p);
+	for (auto addr : Stack) { p = put(p, addr); }
+	p = put(put(p, uint8_t(Variant)), uint8_t(Quirk));
+	p = put(put(put(p, HiRes), Planes), Pitch);
+	p = std::copy(Flags.begin(), Flags.end(), p);
+	p = std::copy(Pattern.begin(), Pattern.end(), p);
+	for (const auto& plane : Display) {
+		for (auto word : plane) { p = put(p, word); }
+	}
+	std::copy_n(Memory.begin(), AddrMask + 1, p);
+}
+
+// Leaves the machine untouched and returns false if in isn't a state this
+// version wrote, was saved with another ROM, or has a stack pointer, mode,
+// quirk profile or display mode out of range.
+bool Chip8::load_state(const State& in) {
+	uint64_t hash;
+	get(&in[HashAt], hash);
+	if (!std::equal(StateMagic.begin(), StateMagic.end(), in.begin()) ||
+	    hash != RomHash || in[SPAt] >= Stack.size() ||
+	    in[ModeAt] > uint8_t(Mode::XOChip) ||
+	    in[ModeAt + 1] > uint8_t(Quirks::XOChip) || in[HiResAt] > 1 ||
+	    in[HiResAt + 1] > 3) {
+		return false;
+	}
+	const uint8_t* p = in.data() + StateMagic.size();
+
+	p = get(get(get(p, DT), SP), ST);
+	p = get(get(get(p, I), OC), PC);
+	p = get(get(p, Seed), Rng.State);
+	p = get(p, Cycles) + sizeof(RomHash);
+	std::copy_n(p, Key.size(), Key.begin()), p += Key.size();
+	std::copy_n(p, V.size(), V.begin()), p += V.size();
+	for (auto& addr : Stack) { p = get(p, addr); }
+	uint8_t mode;
+	uint8_t quirks;
+	p = get(get(p, mode), quirks);
+	p = get(get(get(p, HiRes), Planes), Pitch);
+	std::copy_n(p, Flags.size(), Flags.begin()), p += Flags.size();
+	std::copy_n(p, Pattern.size(), Pattern.begin()), p += Pattern.size();
+	for (auto& plane : Display) {
+		for (auto& word : plane) { p = get(p, word); }
+	}
+
+	DirtyRows = ~0ULL;
+	Quirk     = static_cast<Quirks>(quirks);
+	set_mode(static_cast<Mode>(mode));
+	std::copy_n(p, AddrMask + 1, Memory.begin());
+	return true;
+}
+
+bool Chip8::save_state(const char* filename) const {
+	State st;
+	save_state(st);
+	std::ofstream out(filename, std::ios::binary);
+	out.write(reinterpret_cast<const char*>(st.data()), state_size());
+	return out.good();
+}
+
+bool Chip8::load_state(const char* filename) {
+	State         st;
+	std::ifstream in(filename, std::ios::binary);
+	in.read(reinterpret_cast<char*>(st.data()), st.size());
+	const auto size = static_cast<size_t>(in.gcount());
+	return size > ModeAt && size == state_bytes(st[ModeAt]) && load_state(st);
+}
+
+// Called at 60 Hz by the scheduler, not per instruction.
+void Chip8::tick_timers() {
 	if (DT > 0) { --DT; }
 	if (ST > 0) { --ST; }
 }
+
+// Called when Idle is set: if the machine is in a wait that can't end before
+// the next timer tick or key change, accounts for up to n cycles of it
+// without running them and returns how many. The state afterwards is exactly
+// what running them would have left. Tracers and profilers see every
+// instruction, so nothing is skipped while one is attached.
+uint64_t Chip8::idle(uint64_t n) {
+	Idle = false;
+	if (Trace != nullptr) { return 0; }
+#ifdef Profile
+	if (Prof != nullptr) { return 0; }
+#endif
+
+	const auto word = [&](uint16_t addr) -> uint16_t {
+		return Memory[addr & AddrMask] << 8 | Memory[(addr + 1) & AddrMask];
+	};
+	const uint16_t pc = PC & AddrMask;
+	const uint16_t op = word(pc);
+	const uint8_t  x  = (op >> 8) & 0xF;
+
+	Wait     wait = Wait::None;
+	uint64_t skip = n;
+	if ((op & 0xF0FF) == 0xF00A && key_mask() == 0) {
+		wait = Wait::Key;
+	} else if ((op == 0x00FD && Variant != Mode::Chip8) ||
+	           op == (0x1000 | pc)) {
+		wait = Wait::Halt;
+	} else if ((op & 0xF0FF) == 0xF007 && DT != 0 &&
+	           word(pc + 2) == (0x3000 | x << 8) &&
+	           word(pc + 4) == (0x1000 | pc)) {
+		// Whole trips round the three-instruction loop only.
+		wait = Wait::Timer;
+		skip = n - n % 3;
+	}
+	if (wait == Wait::None || skip == 0) { return 0; }
+
+	if (wait == Wait::Timer) { V[x] = DT; }  // As the last FX07 left it
+	Waiting = wait;
+	Cycles += skip;
+	Skipped += skip;
+	return skip;
+}
@@ -2,9 +2,127 @@
 #define _C8E_CHIP8_HH_
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+
+#include "rom.hh"
+
+struct Chip8;
+struct Profiler;
+struct Tracer;
+
+// xorshift32 for CXNN. Small enough to live in every instance and fully
+// determined by its seed, so replays, save states and pooled instances are
+// bit-exact.
+struct Random {
+	uint32_t State{1};
+
+	void seed(uint32_t s) { State = s != 0 ? s : 0x9E3779B9; }  // Never 0
+
+	uint8_t next() {
+		State ^= State << 13;
+		State ^= State >> 17;
+		State ^= State << 5;
+		return State >> 24;
+	}
+
+	bool operator==(const Random& o) const { return State == o.State; }
+	bool operator!=(const Random& o) const { return State != o.State; }
+};
+
+// A pre-decoded instruction: the handler that executes it plus its operands.
+struct Instr {
+	using Handler = void (*)(Chip8&, const Instr&);
+
+	Handler  Fn{};
+	uint16_t OC{};  // Opcode
+	uint16_t NNN{};
+	uint8_t  NN{};
+	uint8_t  N{};
+	uint8_t  X{};
+	uint8_t  Y{};
+};
+
+// Instruction set. SCHIP adds the 128x64 mode, scrolling and the large font;
+// XO-CHIP adds 64 KB of memory, a second bitplane and audio patterns on top.
+enum class Mode : uint8_t { Chip8, SChip, XOChip };
+
+// "chip8", "schip" or "xochip"; false for anything else.
+bool parse_mode(const char* name, Mode& mode);
+
+// Interpreter behaviors ROMs disagree on, as the machines they were written
+// for had them. Default is this emulator's original choice set: shifts use
+// Vx, FX55/FX65 leave I alone, BNNN adds V0, sprites clip, and 8XY1-3 keep
+// VF. The others follow the COSMAC VIP, CHIP-48, SUPER-CHIP 1.1 and Octo's
+// XO-CHIP.
+enum class Quirks : uint8_t { Default, VIP, CHIP48, SChip, XOChip };
+
+// "default", "vip", "chip48", "schip" or "xochip"; false for anything else.
+bool parse_quirks(const char* name, Quirks& quirks);
+
+// Quirk flags. Each profile is a fixed combination, passed as the template
+// argument of the handlers that care, so a profile costs nothing once decoded.
+// The recompilers and the analyzer read the same set.
+enum QuirkFlag : uint8_t {
+	ShiftVy = 1 << 0,  // 8XY6/8XYE shift Vy into Vx
+	IncI    = 1 << 1,  // FX55/FX65 leave I past the last register
+	IncIX   = 1 << 2,  // FX55/FX65 advance I by x
+	JumpVx  = 1 << 3,  // BXNN jumps to xnn + Vx
+	Wrap    = 1 << 4,  // DXYN wraps around the edges instead of clipping
+	VfReset = 1 << 5,  // 8XY1/8XY2/8XY3 clear VF
+};
+
+constexpr uint8_t quirk_flags(Quirks q) {
+	switch (q) {
+		case Quirks::VIP: return ShiftVy | IncI | VfReset;
+		case Quirks::CHIP48: return IncIX | JumpVx;
+		case Quirks::SChip: return JumpVx;
+		case Quirks::XOChip: return ShiftVy | IncI | Wrap;
+		default: return 0;
+	}
+}
+
+// What a machine spinning in place is waiting for: a key (FX0A), DT to run
+// out (an FX07 / 3X00 / jump-back loop) or nothing at all (00FD, or a jump
+// to itself).
+enum class Wait : uint8_t { None, Key, Timer, Halt };
+
+// Largest ROM mode has room for.
+constexpr size_t rom_limit(Mode mode) {
+	return mode == Mode::XOChip ? Rom::MaxXOSize : Rom::MaxSize;
+}
 
 struct Chip8 {
+	static constexpr size_t MemorySize = 0x10000;  // XO-CHIP; others mask
+	static constexpr size_t CodeSize   = 0x1000;   // Range of the decode cache
+	static constexpr size_t PageSize   = 256;      // Granularity of DirtyPages
+	static constexpr size_t Pages      = MemorySize / PageSize;
+
+	// Save state layout: "C8S", version, then CoreSize bytes of registers,
+	// ROM hash, keys, stack, mode, quirks, flags, audio pattern and display,
+	// then Memory up to AddrMask. Multi-byte fields are little-endian.
+	static constexpr size_t CoreSize =
+	    4 + 3 + 6 + 8 + 8 + 8 + 16 + 16 + 32 + 5 + 16 + 16 + 2 * 128 * 8;
+	static constexpr size_t StateSize = CoreSize + MemorySize;
+	using State                       = std::array<uint8_t, StateSize>;
+
+	// Bytes of a State in use for the current mode: 4 KB of memory for
+	// CHIP-8 and SCHIP rather than all 64 KB.
+	size_t state_size() const { return CoreSize + AddrMask + 1; }
+
+	// Memory as it was right after loading, shared by every machine running
+	// the same ROM. reset() returns to it.
+	struct Pristine {
+		std::array<uint8_t, MemorySize> Memory;
+		uint64_t                        RomHash;
+	};
+
+	// One bitplane. Row y is word y for x 0-63 and word 64 + y for x 64-127,
+	// bit 63 first, so low-res rows are words 0-31 and scrolls and sprites
+	// move whole words.
+	using Plane = std::array<uint64_t, 128>;
+
 	uint8_t DT{};  // Delay Timer
 	uint8_t SP{};  // Stack Pointer
 	uint8_t ST{};  // Sound Timer
@@ -13,15 +131,100 @@ struct Chip8 {
 	uint16_t OC{};  // Opcode
 	uint16_t PC{};  // Program Counter
 
-	std::array<uint8_t, 16>   Key{};
-	std::array<uint8_t, 16>   V{};  // General Purpose Registers
-	std::array<uint8_t, 2048> Display{};
-	std::array<uint8_t, 4096> Memory{};
+	std::array<uint8_t, 16>         Key{};
+	std::array<uint8_t, 16>         V{};  // General Purpose Registers
+	std::array<uint8_t, MemorySize> Memory{};
+
+	Mode     Variant{};        // Kept across init_or_reset, see set_mode
+	Quirks   Quirk{};          // Likewise, see set_quirks
+	uint16_t AddrMask{0xFFF};  // Memory wraps here
+	bool     HiRes{};          // 128x64 instead of 64x32
+	uint8_t  Planes{1};        // Bitplanes DXYN and scrolls act on
+	uint8_t  Pitch{64};        // XO-CHIP pattern playback rate
+
+	std::array<uint8_t, 16> Flags{};    // SCHIP RPL user flags
+	std::array<uint8_t, 16> Pattern{};  // XO-CHIP audio pattern
+
+	std::array<Plane, 2> Display{};
+	uint64_t             DirtyRows{};  // Rows changed since last cleared
 
 	std::array<uint16_t, 16> Stack{};
 
-	void init_or_reset();
-	void load_rom(const char* filename);
-	void emulate_cycle();
+	uint32_t Seed{};  // Rng start state, reapplied by init_or_reset
+	Random   Rng;
+
+	uint64_t Cycles{};   // Instructions executed since reset
+	uint64_t Skipped{};  // Of those, accounted for by idle() without running
+	uint64_t RomHash{};  // FNV-1a of the loaded ROM
+	bool     Idle{};     // The last instruction may have started a wait
+	Wait     Waiting{};  // What idle() last skipped cycles of
+
+	// Decode cache for 0x000-0xFFF, one entry per address. Entries are
+	// decoded lazily on first execution and dropped again when the bytes under
+	// them change. XO-CHIP code above it is decoded as it runs.
+	std::array<Instr, CodeSize> Decoded{};
+	uint32_t                    CodeGen{};  // Bumped when decoded code changes
+
+	std::shared_ptr<const Pristine>  Image;
+	std::array<uint64_t, Pages / 64> DirtyPages{};  // May differ from Image
+
+	Tracer* Trace{};  // Records every interpreted instruction when set
+
+#ifdef Profile
+	Profiler* Prof{};  // Accounts for every interpreted instruction when set
+#endif
+
+	void      init_or_reset();
+	void      seed(uint32_t s);
+	void      set_mode(Mode m);
+	void      set_quirks(Quirks q);
+	LoadError load_rom(const char* filename);
+	void      load_rom(const Rom& rom);
+	void      capture_pristine();
+	void      use_pristine(std::shared_ptr<const Pristine> image);
+	void      reset();
+	void      emulate_cycle();
+	void      tick_timers();
+	uint64_t  idle(uint64_t n);
+
+	void         write_mem(uint16_t addr, uint8_t value);
+	void         invalidate_code();
+	const Instr& decoded(uint16_t addr);
+
+	void save_state(State& out) const;
+	bool load_state(const State& in);
+	bool save_state(const char* filename) const;
+	bool load_state(const char* filename);
+
+	uint16_t key_mask() const {
+		uint16_t mask = 0;
+		for (uint8_t k = 0; k != 16; ++k) { mask |= (Key[k] != 0) << k; }
+		return mask;
+	}
+	void set_key_mask(uint16_t mask) {
+		for (uint8_t k = 0; k != 16; ++k) { Key[k] = (mask >> k) & 1; }
+	}
+
+	uint8_t width() const { return HiRes ? 128 : 64; }
+	uint8_t height() const { return HiRes ? 64 : 32; }
+
+	// Color index of a pixel, one bit per plane.
+	uint8_t pixel(uint8_t x, uint8_t y) const {
+		const size_t  word  = x < 64 ? y : 64 + y;
+		const uint8_t shift = 63 - (x & 63);
+		return ((Display[0][word] >> shift) & 1) |
+		       ((Display[1][word] >> shift) & 1) << 1;
+	}
+
+	// Opcodes outside mode's instruction set decode as unknown. The handlers
+	// come specialized for quirks.
+	static Instr decode(uint16_t opcode, Mode mode = Mode::Chip8,
+	                    Quirks quirks = Quirks::Default);
+
+	// False for opcodes decode() leaves to the unknown-opcode handler.
+	static bool known(uint16_t opcode, Mode mode = Mode::Chip8);
+
+private:
+	void execute(const Instr& in);
 };
 #endif
@@ -0,0 +1,96 @@
+#include "disasm.hh"
+
+#include <cstdio>
+
+std::string disasm(uint16_t opcode, Mode mode) {
+	const Instr in    = Chip8::decode(opcode, mode);
+	const bool  schip = mode != Mode::Chip8;
+	const bool  xo    = mode == Mode::XOChip;
+	char        buf[32];
+
+	auto fmt = [&](const char* f, auto... args) {
+		std::snprintf(buf, sizeof(buf), f, args...);
+		return std::string(buf);
+	};
+	auto bad = [&] { return fmt("DW 0x%04X", opcode); };
+	auto xy  = [&](const char* m) { return fmt("%s V%X, V%X", m, in.X, in.Y); };
+	auto xnn = [&](const char* m) {
+		return fmt("%s V%X, 0x%02X", m, in.X, in.NN);
+	};
+
+	switch (opcode & 0xF000) {
+		case 0x0000:
+			if (opcode == 0x00E0) { return "CLS"; }
+			if (opcode == 0x00EE) { return "RET"; }
+			if (schip) {
+				switch (in.NN) {
+					case 0xFB: return "SCR";
+					case 0xFC: return "SCL";
+					case 0xFD: return "EXIT";
+					case 0xFE: return "LOW";
+					case 0xFF: return "HIGH";
+					default: break;
+				}
+				if ((in.NN & 0xF0) == 0xC0) { return fmt("SCD %u", in.N); }
+			}
+			if (xo && (in.NN & 0xF0) == 0xD0) { return fmt("SCU %u", in.N); }
+			return bad();
+		case 0x1000: return fmt("JP 0x%03X", in.NNN);
+		case 0x2000: return fmt("CALL 0x%03X", in.NNN);
+		case 0x3000: return xnn("SE");
+		case 0x4000: return xnn("SNE");
+		case 0x5000:
+			// Low nibble ignored, as in decode
+			if (xo && in.N == 0x2) { return xy("SAVE"); }
+			if (xo && in.N == 0x3) { return xy("LOAD"); }
+			return xy("SE");
+		case 0x6000: return xnn("LD");
+		case 0x7000: return xnn("ADD");
+		case 0x8000:
+			switch (in.N) {
+				case 0x0: return xy("LD");
+				case 0x1: return xy("OR");
+				case 0x2: return xy("AND");
+				case 0x3: return xy("XOR");
+				case 0x4: return xy("ADD");
+				case 0x5: return xy("SUB");
+				case 0x6: return xy("SHR");
+				case 0x7: return xy("SUBN");
+				case 0xE: return xy("SHL");
+				default: return bad();
+			}
+		case 0x9000: return xy("SNE");
+		case 0xA000: return fmt("LD I, 0x%03X", in.NNN);
+		case 0xB000: return fmt("JP V0, 0x%03X", in.NNN);
+		case 0xC000: return xnn("RND");
+		case 0xD000: return fmt("DRW V%X, V%X, %u", in.X, in.Y, in.N);
+		case 0xE000:
+			if (in.NN == 0x9E) { return fmt("SKP V%X", in.X); }
+			if (in.NN == 0xA1) { return fmt("SKNP V%X", in.X); }
+			return bad();
+		default:
+			if (xo) {
+				if (opcode == 0xF000) { return "LD I, LONG"; }
+				if (opcode == 0xF002) { return "AUDIO"; }
+				if (in.NN == 0x01) { return fmt("PLANE %u", in.X); }
+				if (in.NN == 0x3A) { return fmt("PITCH V%X", in.X); }
+			}
+			if (schip) {
+				if (in.NN == 0x30) { return fmt("LD HF, V%X", in.X); }
+				if (in.NN == 0x75) { return fmt("LD R, V%X", in.X); }
+				if (in.NN == 0x85) { return fmt("LD V%X, R", in.X); }
+			}
+			switch (in.NN) {
+				case 0x07: return fmt("LD V%X, DT", in.X);
+				case 0x0A: return fmt("LD V%X, K", in.X);
+				case 0x15: return fmt("LD DT, V%X", in.X);
+				case 0x18: return fmt("LD ST, V%X", in.X);
+				case 0x1E: return fmt("ADD I, V%X", in.X);
+				case 0x29: return fmt("LD F, V%X", in.X);
+				case 0x33: return fmt("LD B, V%X", in.X);
+				case 0x55: return fmt("LD [I], V%X", in.X);
+				case 0x65: return fmt("LD V%X, [I]", in.X);
+				default: return bad();
+			}
+	}
+}
@@ -0,0 +1,13 @@
+#ifndef _C8E_DISASM_HH_
+#define _C8E_DISASM_HH_
+
+#include <cstdint>
+#include <string>
+
+#include "chip8.hh"
+
+// Cowgod-style mnemonic for one opcode, e.g. "DRW V1, V2, 5". Opcodes the
+// interpreter doesn't know in mode come out as "DW 0xNNNN". F000's operand
+// is the next word, which isn't shown.
+std::string disasm(uint16_t opcode, Mode mode = Mode::Chip8);
+#endif
@@ -0,0 +1,16 @@
+#ifndef _C8E_HASH_HH_
+#define _C8E_HASH_HH_
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit FNV-1a, used to identify ROM images.
+inline uint64_t fnv1a(const uint8_t* data, size_t size) {
+	uint64_t h = 0xCBF29CE484222325ULL;
+	for (size_t i = 0; i != size; ++i) {
+		h ^= data[i];
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
+#endif
@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "aot.hh"
+#include "audio.hh"
+#include "chip8.hh"
+#include "inputlog.hh"
+#include "jit.hh"
+#include "library.hh"
+#include "pool.hh"
+#ifdef Profile
+#include "profiler.hh"
+#endif
+#include "scheduler.hh"
+#include "trace.hh"
+#include "video.hh"
+
+// Batch runner: no window, no event polling, no vsync. Runs ROMs for a fixed
+// number of cycles or 60 Hz frames and writes out the final machine states.
+// Instances are independent and spread over all cores.
+
+namespace {
+void usage(const char* prog) {
+	std::cerr << "usage: " << prog
+	          << " [-c cycles | -f frames] [-r ips] [-b interp|jit|check|aot]"
+	             " [-m chip8|schip|xochip] [-q quirks]"
+	             " [-l state] [-w state] [-p inputlog] [-T trace] [-n copies]"
+	             " [-s seed] [-t threads] [-o out] [-A]"
+	             " [-d dir [-F png|raw|y4m] [-x scale]] rom|dir...\n";
+#ifdef Profile
+	std::cerr << "  -P folded: profile, call stacks go to folded for "
+	             "flamegraph.pl\n";
+#endif
+}
+
+struct Options {
+	uint64_t              Cycles{};
+	uint64_t              Frames{600};
+	uint32_t              Rate{Scheduler{}.Rate};
+	const char*           Backend{"interp"};
+	Mode                  Variant{Mode::Chip8};
+	std::optional<Quirks> Quirk;  // Overrides the ROM index
+	const char*           LoadPath{};
+	const char*           SavePath{};
+	const char*           ReplayPath{};  // Keys, seed, rate, mode, quirks
+	const char*           ProfilePath{};
+	const char*           TracePath{};  // Last 2^20 steps
+	bool                  Sound{};      // Render audio into a null sink
+	std::string           DumpFormat{"png"};
+	uint32_t              Scale{1};
+};
+
+struct Job {
+	std::string                            Path;
+	std::shared_ptr<const Chip8::Pristine> Image;  // Shared by all copies
+	Quirks                                 Quirk;
+	uint32_t                               Seed;
+	std::string                            Out;  // Final state dump
+	bool                                   Diverged;
+	bool                                   Failed;  // A file couldn't be used
+	std::string                            Folded;  // Call stacks, with -P
+	std::string                            Dump;    // Frame file, with -d
+};
+
+void dump_state(std::ostream& os, const Chip8& c8) {
+	os << std::hex << std::uppercase << std::setfill('0');
+	os << "PC " << std::setw(3) << c8.PC << "  I " << std::setw(3) << c8.I
+	   << "  SP " << +c8.SP << "  DT " << std::setw(2) << +c8.DT << "  ST "
+	   << std::setw(2) << +c8.ST << "\n";
+	for (uint8_t i = 0; i != 16; ++i) {
+		os << "V" << +i << " " << std::setw(2) << +c8.V[i]
+		   << (i % 8 == 7 ? "\n" : "  ");
+	}
+	os << "Stack";
+	for (auto addr : c8.Stack) { os << " " << std::setw(3) << addr; }
+	os << "\n";
+
+	// Plane 0 only is '#', plane 1 only '+', both '*'.
+	for (uint8_t y = 0; y != c8.height(); ++y) {
+		for (uint8_t x = 0; x != c8.width(); ++x) {
+			os << ".#+*"[c8.pixel(x, y)];
+		}
+		os << "\n";
+	}
+	os << std::dec;
+}
+
+// One independent machine, run start to finish on a pool worker.
+void run_job(const Options& opt, Job& job) {
+	// Ends the job early, reporting why in place of the state dump.
+	const auto fail = [&](const std::string& why) {
+		job.Out    = why + "\n";
+		job.Failed = true;
+	};
+
+	Scheduler sched;
+	sched.Rate = opt.Rate;
+
+	const std::string_view backend = opt.Backend;
+	Jit                    jit;
+	Aot                    aot;
+	if (backend == "aot") {
+		sched.Translated = &aot;
+	} else if (backend != "interp") {
+		jit.Check        = backend == "check";
+		sched.Recompiler = &jit;
+	}
+
+	InputPlayer player;
+	if (opt.ReplayPath != nullptr) {
+		if (!player.open(opt.ReplayPath)) {
+			fail(std::string("can't read input log ") + opt.ReplayPath);
+			return;
+		}
+		sched.Rate   = player.Log.Rate;
+		sched.Replay = &player;
+		job.Seed     = player.Log.Seed;
+	}
+
+	Chip8 c8;
+	c8.set_mode(opt.Variant);
+	c8.set_quirks(job.Quirk);
+	c8.use_pristine(job.Image);
+	c8.seed(job.Seed);
+	c8.reset();
+	if (opt.ReplayPath != nullptr && c8.RomHash != player.Log.RomHash) {
+		fail("input log was recorded with another ROM");
+		return;
+	}
+	std::unique_ptr<Tracer> trace;
+	if (opt.TracePath != nullptr) {
+		trace    = std::make_unique<Tracer>();
+		c8.Trace = trace.get();
+	}
+#ifdef Profile
+	Profiler prof;
+	if (opt.ProfilePath != nullptr) { c8.Prof = &prof; }
+#endif
+	if (opt.LoadPath != nullptr && !c8.load_state(opt.LoadPath)) {
+		fail(std::string("can't load state from ") + opt.LoadPath);
+		return;
+	}
+
+	// The sink pulls one tick of samples per tick run, so the ring neither
+	// fills nor drains unless the audio path itself is wrong.
+	Audio    audio;
+	NullSink sink;
+	if (opt.Sound) {
+		audio.Prime = 1;
+		sched.Sound = &audio;
+	}
+	// A video gets a frame per tick, always at the high-res size so the
+	// stream can't change shape. After a failed write the run goes on, but
+	// the video is given up on.
+	Image     image;
+	Y4mWriter video;
+	const bool recordVideo = !job.Dump.empty() && opt.DumpFormat == "y4m";
+	bool       videoOk     = true;
+	if (recordVideo &&
+	    !video.open(job.Dump.c_str(), 128 * opt.Scale, 64 * opt.Scale)) {
+		fail("can't write video to " + job.Dump);
+		return;
+	}
+	const auto afterTick = [&] {
+		if (sched.Busy) { return; }
+		if (opt.Sound) { sink.pull(audio, Audio::SamplesPerTick); }
+		if (recordVideo && videoOk) {
+			render(c8.Display, c8.HiRes, opt.Scale << !c8.HiRes, image);
+			videoOk = video.write(image);
+		}
+	};
+
+	// Same tick cadence as the SDL frontend, minus the wall clock.
+	if (opt.Cycles != 0) {
+		for (uint64_t ran = 0; ran != opt.Cycles && !jit.Diverged;) {
+			ran += sched.step_tick(c8, opt.Cycles - ran);
+			afterTick();
+		}
+	} else {
+		for (uint64_t f = 0; f != opt.Frames && !jit.Diverged; ++f) {
+			sched.step_tick(c8);
+			afterTick();
+		}
+	}
+
+	if (recordVideo && !(videoOk && video.close())) {
+		std::cerr << "can't write video to " << job.Dump << "\n";
+		job.Failed = true;
+	}
+	if (!job.Dump.empty() && !recordVideo) {
+		render(c8.Display, c8.HiRes, opt.Scale, image);
+		const bool ok = opt.DumpFormat == "png"
+		                    ? write_png(job.Dump.c_str(), image)
+		                    : write_raw(job.Dump.c_str(), image);
+		if (!ok) {
+			std::cerr << "can't write frame to " << job.Dump << "\n";
+			job.Failed = true;
+		}
+	}
+
+	if (opt.SavePath != nullptr && !c8.save_state(opt.SavePath)) {
+		std::cerr << "can't write state to " << opt.SavePath << "\n";
+		job.Failed = true;
+	}
+	if (trace && !trace->save(opt.TracePath)) {
+		std::cerr << "can't write trace to " << opt.TracePath << "\n";
+		job.Failed = true;
+	}
+	std::ostringstream os;
+	dump_state(os, c8);
+	if (opt.Sound) {
+		os << "audio: " << sink.Samples << " samples, " << sink.Audible
+		   << " audible, " << audio.Underruns << " underruns, "
+		   << audio.Dropped << " dropped\n";
+	}
+#ifdef Profile
+	if (c8.Prof != nullptr) {
+		os << "\n";
+		prof.report(os);
+		std::ostringstream folded;
+		prof.write_folded(folded);
+		job.Folded = folded.str();
+	}
+#endif
+	job.Out      = os.str();
+	job.Diverged = jit.Diverged;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+	std::vector<std::pair<std::string, std::string>> roms;  // Path, quirks
+	Options                                          opt;
+	const char*                                      outPath = nullptr;
+	uint32_t                                         copies  = 1;
+	uint32_t                                         seed    = 0;
+	unsigned                                         threads = 0;
+	const char*                                      dumpDir = nullptr;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		if (arg == "-c" && i + 1 < argc) {
+			opt.Cycles = std::strtoull(argv[++i], nullptr, 10);
+			opt.Frames = 0;
+		} else if (arg == "-f" && i + 1 < argc) {
+			opt.Frames = std::strtoull(argv[++i], nullptr, 10);
+			opt.Cycles = 0;
+		} else if (arg == "-r" && i + 1 < argc) {
+			opt.Rate = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "-b" && i + 1 < argc) {
+			opt.Backend = argv[++i];
+		} else if (arg == "-m" && i + 1 < argc) {
+			if (!parse_mode(argv[++i], opt.Variant)) {
+				usage(argv[0]);
+				return -1;
+			}
+		} else if (arg == "-q" && i + 1 < argc) {
+			Quirks q;
+			if (!parse_quirks(argv[++i], q)) {
+				usage(argv[0]);
+				return -1;
+			}
+			opt.Quirk = q;
+		} else if (arg == "-l" && i + 1 < argc) {
+			opt.LoadPath = argv[++i];
+		} else if (arg == "-w" && i + 1 < argc) {
+			opt.SavePath = argv[++i];
+		} else if (arg == "-T" && i + 1 < argc) {
+			opt.TracePath = argv[++i];
+		} else if (arg == "-p" && i + 1 < argc) {
+			opt.ReplayPath = argv[++i];
+#ifdef Profile
+		} else if (arg == "-P" && i + 1 < argc) {
+			opt.ProfilePath = argv[++i];
+#endif
+		} else if (arg == "-n" && i + 1 < argc) {
+			copies = std::max(1UL, std::strtoul(argv[++i], nullptr, 10));
+		} else if (arg == "-s" && i + 1 < argc) {
+			seed = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "-t" && i + 1 < argc) {
+			threads = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "-o" && i + 1 < argc) {
+			outPath = argv[++i];
+		} else if (arg == "-A") {
+			opt.Sound = true;
+		} else if (arg == "-d" && i + 1 < argc) {
+			dumpDir = argv[++i];
+		} else if (arg == "-F" && i + 1 < argc) {
+			opt.DumpFormat = argv[++i];
+		} else if (arg == "-x" && i + 1 < argc) {
+			opt.Scale = std::clamp(std::strtoul(argv[++i], nullptr, 10), 1UL,
+			                       64UL);
+		} else if (arg[0] == '-') {
+			usage(argv[0]);
+			return -1;
+		} else if (std::filesystem::is_directory(argv[i])) {
+			RomLibrary lib;
+			if (!lib.scan(argv[i])) {
+				std::cerr << "can't update the index of " << argv[i] << "\n";
+			}
+			for (const auto& e : lib.Entries) {
+				roms.emplace_back(lib.path(e), e.Quirks);
+			}
+		} else {
+			roms.emplace_back(argv[i], "default");
+		}
+	}
+	const std::string_view mode = opt.Backend;
+	const std::string_view format = opt.DumpFormat;
+	if (roms.empty() || opt.Rate == 0 ||
+	    (mode != "interp" && mode != "jit" && mode != "check" &&
+	     mode != "aot") ||
+	    (format != "png" && format != "raw" && format != "y4m")) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	// A replay runs in the mode and with the quirks it was recorded with.
+	if (opt.ReplayPath != nullptr) {
+		InputPlayer header;
+		if (!header.open(opt.ReplayPath)) {
+			std::cerr << "can't read input log " << opt.ReplayPath << "\n";
+			return -1;
+		}
+		opt.Variant = header.Log.Variant;
+		opt.Quirk   = header.Log.Quirk;
+	}
+
+	// Each ROM is read once into a pristine image its copies reset from.
+	// Copy i runs with seed + i. -q wins over the quirks a directory's index
+	// gives.
+	std::vector<Job> jobs;
+	for (const auto& [path, profile] : roms) {
+		Quirks quirks = opt.Quirk.value_or(Quirks::Default);
+		if (!opt.Quirk && !parse_quirks(profile.c_str(), quirks)) {
+			std::cerr << path << ": unknown quirk profile " << profile << "\n";
+			return -1;
+		}
+		Rom             rom;
+		const LoadError err = rom.open(path.c_str(), rom_limit(opt.Variant));
+		if (err != LoadError::None) {
+			std::cerr << path << ": " << describe(err) << "\n";
+			return -1;
+		}
+		Chip8 boot;
+		boot.set_mode(opt.Variant);
+		boot.init_or_reset();
+		boot.load_rom(rom);
+		boot.capture_pristine();
+		for (uint32_t i = 0; i != copies; ++i) {
+			jobs.push_back(
+			    {path, boot.Image, quirks, seed + i, {}, false, false, {}, {}});
+
+			// <dir>/<rom>.<format>, or <rom>-<seed>.<format> for copies.
+			if (dumpDir != nullptr) {
+				std::string name = std::filesystem::path(path).stem().string();
+				if (copies != 1) { name += "-" + std::to_string(seed + i); }
+				jobs.back().Dump = (std::filesystem::path(dumpDir) /
+				                    (name + "." + opt.DumpFormat))
+				                       .string();
+			}
+		}
+	}
+	if ((opt.SavePath != nullptr || opt.TracePath != nullptr) &&
+	    jobs.size() != 1) {
+		std::cerr << "-w and -T need a single instance\n";
+		return -1;
+	}
+	if (opt.ReplayPath != nullptr && opt.LoadPath != nullptr) {
+		std::cerr << "-p replays from power-on and can't start from -l\n";
+		return -1;
+	}
+
+	Pool pool(threads);
+	pool.run(jobs.size(), [&](size_t i) { run_job(opt, jobs[i]); });
+
+	std::ofstream file;
+	if (outPath != nullptr) { file.open(outPath); }
+	std::ostream& out = outPath != nullptr ? file : std::cout;
+
+	std::ofstream folded;
+	if (opt.ProfilePath != nullptr) { folded.open(opt.ProfilePath); }
+
+	bool failed = false;
+	for (const auto& job : jobs) {
+		folded << job.Folded;
+		if (jobs.size() != 1) {
+			out << "== " << job.Path << " seed " << job.Seed << "\n";
+		}
+		out << job.Out;
+		failed |= job.Diverged || job.Failed;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+#include "inputlog.hh"
+
+#include <array>
+
+namespace {
+constexpr std::array<char, 4> Magic{'C', '8', 'I', 'L'};
+
+template <typename T>
+void put(std::ostream& os, T v) {
+	for (size_t i = 0; i != sizeof(T); ++i) { os.put((v >> (8 * i)) & 0xFF); }
+}
+
+template <typename T>
+bool get(std::istream& is, T& v) {
+	v = 0;
+	for (size_t i = 0; i != sizeof(T); ++i) {
+		const int c = is.get();
+		if (c == EOF) { return false; }
+		v |= T(c) << (8 * i);
+	}
+	return true;
+}
+
+void put_varint(std::ostream& os, uint64_t v) {
+	for (; v >= 0x80; v >>= 7) { os.put((v & 0x7F) | 0x80); }
+	os.put(v);
+}
+
+bool get_varint(std::istream& is, uint64_t& v) {
+	v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		const int c = is.get();
+		if (c == EOF) { return false; }
+		v |= uint64_t(c & 0x7F) << shift;
+		if ((c & 0x80) == 0) { return true; }
+	}
+	return false;
+}
+}  // namespace
+
+// Starts a log for c8 as it is now, which should be straight after reset and
+// ROM load.
+bool InputRecorder::open(const char* filename, const Chip8& c8,
+                         uint32_t rate) {
+	Out.open(filename, std::ios::binary);
+	Out.write(Magic.data(), Magic.size());
+	put(Out, InputLog::Version);
+	put(Out, rate);
+	put(Out, c8.Seed);
+	put(Out, c8.RomHash);
+	put(Out, uint8_t(c8.Variant));
+	put(Out, uint8_t(c8.Quirk));
+
+	LastCycle = c8.Cycles;
+	LastMask  = 0;
+	record(c8);
+	return Out.good();
+}
+
+// Call whenever keys may have changed; only actual changes are written.
+void InputRecorder::record(const Chip8& c8) {
+	const uint16_t mask = c8.key_mask();
+	if (!Out.is_open() || mask == LastMask) { return; }
+
+	put_varint(Out, c8.Cycles - LastCycle);
+	put(Out, mask);
+	LastCycle = c8.Cycles;
+	LastMask  = mask;
+}
+
+bool InputPlayer::open(const char* filename) {
+	In.open(filename, std::ios::binary);
+
+	std::array<char, 4> magic{};
+	uint8_t             version = 0;
+	uint8_t             mode    = 0;
+	uint8_t             quirks  = 0;
+	In.read(magic.data(), magic.size());
+	if (magic != Magic || !get(In, version) || version != InputLog::Version ||
+	    !get(In, Log.Rate) || !get(In, Log.Seed) || !get(In, Log.RomHash) ||
+	    !get(In, mode) || !get(In, quirks) || mode > 2 || quirks > 4) {
+		return false;
+	}
+	Log.Variant = static_cast<Mode>(mode);
+	Log.Quirk   = static_cast<Quirks>(quirks);
+
+	NextCycle = 0;
+	read_next();
+	return true;
+}
+
+void InputPlayer::read_next() {
+	uint64_t delta = 0;
+	if (!get_varint(In, delta) || !get(In, NextMask)) {
+		NextCycle = UINT64_MAX;
+		return;
+	}
+	NextCycle += delta;
+}
+
+// Applies every record due at or before c8's current cycle.
+void InputPlayer::apply(Chip8& c8) {
+	while (NextCycle <= c8.Cycles) {
+		c8.set_key_mask(NextMask);
+		read_next();
+	}
+}
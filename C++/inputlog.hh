@@ -0,0 +1,49 @@
+#ifndef _C8E_INPUTLOG_HH_
+#define _C8E_INPUTLOG_HH_
+
+#include <cstdint>
+#include <fstream>
+
+#include "chip8.hh"
+
+// Input log: a header identifying the run, then one record per change of the
+// 16-key state, written as it happens.
+//
+//   "C8IL" version:u8 rate:u32 seed:u32 romHash:u64 mode:u8 quirks:u8
+//   { cycleDelta:varint keyMask:u16 }...
+//
+// Multi-byte fields are little-endian. A record applies before the
+// instruction at its cycle runs. Replays are exact for throttled runs; with
+// rate 0 timers follow the wall clock and can't be reproduced.
+struct InputLog {
+	static constexpr uint8_t Version = 2;
+
+	uint32_t Rate{};
+	uint32_t Seed{};
+	uint64_t RomHash{};
+	Mode     Variant{};
+	Quirks   Quirk{};
+};
+
+struct InputRecorder {
+	std::ofstream Out;
+	uint64_t      LastCycle{};
+	uint16_t      LastMask{};
+
+	bool open(const char* filename, const Chip8& c8, uint32_t rate);
+	void record(const Chip8& c8);
+};
+
+struct InputPlayer {
+	std::ifstream In;
+	InputLog      Log;
+	uint64_t      NextCycle{UINT64_MAX};  // UINT64_MAX once the log ends
+	uint16_t      NextMask{};
+
+	bool open(const char* filename);
+	void apply(Chip8& c8);
+
+private:
+	void read_next();
+};
+#endif
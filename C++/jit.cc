@@ -0,0 +1,280 @@
+#include "jit.hh"
+
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define C8E_JIT 1
+#endif
+
+namespace {
+constexpr size_t   BufferSize = 1 << 20;
+constexpr size_t   BlockSlack = 4096;  // Worst case for one block
+constexpr uint16_t MaxBlock   = 64;
+
+constexpr int32_t OffV  = offsetof(Chip8, V);
+constexpr int32_t OffI  = offsetof(Chip8, I);
+constexpr int32_t OffPC = offsetof(Chip8, PC);
+constexpr int32_t OffOC = offsetof(Chip8, OC);
+
+// Instructions that leave straight-line code, or store to memory and so may
+// rewrite what follows them.
+bool ends_block(uint16_t oc) {
+	switch (oc & 0xF000) {
+		case 0x0000: return oc != 0x00E0;
+		case 0x1000:
+		case 0x2000:
+		case 0x3000:
+		case 0x4000:
+		case 0x5000:
+		case 0x9000:
+		case 0xB000:
+		case 0xD000:
+		case 0xE000: return true;
+		case 0xF000: {
+			const uint8_t nn = oc & 0xFF;
+			return nn == 0x0A || nn == 0x33 || nn == 0x55;
+		}
+		default: return false;
+	}
+}
+
+struct Emitter {
+	uint8_t* P;
+
+	void u8(uint8_t v) { *P++ = v; }
+	void u16(uint16_t v) { std::memcpy(P, &v, 2), P += 2; }
+	void u32(int32_t v) { std::memcpy(P, &v, 4), P += 4; }
+	void u64(uint64_t v) { std::memcpy(P, &v, 8), P += 8; }
+
+	// op [rbx + disp32] forms; ModRM 0x83 | reg << 3 selects rbx + disp32.
+	void mem(uint8_t op, uint8_t reg, int32_t disp) {
+		u8(op), u8(0x83 | reg << 3), u32(disp);
+	}
+	void mov_word(int32_t disp, uint16_t v) {
+		u8(0x66), mem(0xC7, 0, disp), u16(v);
+	}
+};
+
+// Jumps and skips only decide the next PC, so they're emitted as stores.
+bool emit_branch(Emitter& e, const Instr& in, uint16_t addr) {
+	const int32_t vx = OffV + in.X;
+	const int32_t vy = OffV + in.Y;
+
+	uint8_t skipUnless = 0;  // jcc over the "skip" store
+	switch (in.OC & 0xF000) {
+		case 0x1000: e.mov_word(OffPC, in.NNN); return true;
+		case 0x3000: e.mem(0x80, 7, vx), e.u8(in.NN), skipUnless = 0x75; break;
+		case 0x4000: e.mem(0x80, 7, vx), e.u8(in.NN), skipUnless = 0x74; break;
+		case 0x5000:
+		case 0x9000:
+			if (in.N != 0) { return false; }
+			e.mem(0x8A, 0, vy);  // mov al, Vy
+			e.mem(0x38, 0, vx);  // cmp Vx, al
+			skipUnless = (in.OC & 0xF000) == 0x5000 ? 0x75 : 0x74;
+			break;
+		default: return false;
+	}
+	// Flags survive the plain stores: mov PC, addr + 2; jcc +9; mov PC, +4.
+	e.mov_word(OffPC, addr + 2);
+	e.u8(skipUnless), e.u8(9);
+	e.mov_word(OffPC, addr + 4);
+	return true;
+}
+
+// Emits native code for in, or returns false if it needs its handler.
+// vfReset: 8XY1-3 also clear VF under the profile, left to the handlers.
+bool emit_inline(Emitter& e, const Instr& in, bool vfReset) {
+	const int32_t vx = OffV + in.X;
+	const int32_t vy = OffV + in.Y;
+
+	switch (in.OC & 0xF000) {
+		case 0x6000: e.mem(0xC6, 0, vx), e.u8(in.NN); return true;  // mov
+		case 0x7000: e.mem(0x80, 0, vx), e.u8(in.NN); return true;  // add
+		case 0xA000: e.mov_word(OffI, in.NNN); return true;
+		case 0x8000: {
+			static constexpr std::array<uint8_t, 4> ops{0x88, 0x08, 0x20, 0x30};
+			if (in.N > 3 || (vfReset && in.N != 0)) { return false; }
+			e.mem(0x8A, 0, vy);       // mov al, Vy
+			e.mem(ops[in.N], 0, vx);  // mov/or/and/xor Vx, al
+			return true;
+		}
+		default: return false;
+	}
+}
+
+// Makes the pages holding [from, to) writable, or executable again once
+// written. The buffer is never both.
+bool set_writable(uint8_t* from, uint8_t* to, bool writable) {
+#ifdef C8E_JIT
+	static const uintptr_t page = sysconf(_SC_PAGESIZE);
+	const uintptr_t        skew = reinterpret_cast<uintptr_t>(from) % page;
+	return mprotect(from - skew, to - from + skew,
+	                PROT_READ | (writable ? PROT_WRITE : PROT_EXEC)) == 0;
+#else
+	static_cast<void>(from), static_cast<void>(to), static_cast<void>(writable);
+	return false;
+#endif
+}
+}  // namespace
+
+Jit::Jit() {
+#ifdef C8E_JIT
+	void* p = mmap(nullptr, BufferSize, PROT_READ | PROT_EXEC,
+	               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p != MAP_FAILED) { Buffer = static_cast<uint8_t*>(p); }
+#endif
+}
+
+Jit::~Jit() {
+#ifdef C8E_JIT
+	if (Buffer != nullptr) { munmap(Buffer, BufferSize); }
+#endif
+}
+
+void Jit::flush() {
+	Blocks.fill({});
+	Operands.clear();
+	Used = 0;
+}
+
+// Block layout: push rbx; mov rbx, rdi; <body>; pop rbx; ret. PC and OC are
+// only stored before handler calls and at the end, where they're observable.
+// A block that can't be emitted comes back empty and is interpreted.
+const Jit::Block& Jit::compile(Chip8& c8, uint16_t pc) {
+	if (Used + BlockSlack > BufferSize) { flush(); }
+
+	Block&         b     = Blocks[pc];
+	uint8_t* const start = Buffer + Used;
+	if (!set_writable(start, start + BlockSlack, true)) { return b; }
+	Emitter e{start};
+	e.u8(0x53), e.u8(0x48), e.u8(0x89), e.u8(0xFB);
+
+	const bool vfReset = (quirk_flags(c8.Quirk) & VfReset) != 0;
+	uint16_t   addr    = pc;
+	uint16_t   lastOC  = 0;
+	bool       synced  = true;
+	while (b.Count != MaxBlock && addr < 0xFFF) {
+		const Instr& in = c8.decoded(addr);
+		lastOC          = in.OC;
+		++b.Count;
+
+		if (emit_inline(e, in, vfReset)) {
+			synced = false;
+			addr += 2;
+			continue;
+		}
+		if (emit_branch(e, in, addr)) {
+			e.mov_word(OffOC, in.OC);
+			synced = true;
+			break;
+		}
+
+		Operands.push_back(in);
+		e.mov_word(OffPC, addr);
+		e.mov_word(OffOC, in.OC);
+		e.u8(0x48), e.u8(0x89), e.u8(0xDF);  // mov rdi, rbx
+		e.u8(0x48), e.u8(0xBE);              // mov rsi, imm64
+		e.u64(reinterpret_cast<uint64_t>(&Operands.back()));
+		e.u8(0x48), e.u8(0xB8);  // mov rax, imm64
+		e.u64(reinterpret_cast<uint64_t>(in.Fn));
+		e.u8(0xFF), e.u8(0xD0);  // call rax
+		synced = true;
+		addr += 2;
+
+		if (ends_block(in.OC)) { break; }
+	}
+	if (!synced) {
+		e.mov_word(OffPC, addr);
+		e.mov_word(OffOC, lastOC);
+	}
+	e.u8(0x5B), e.u8(0xC3);
+
+	// Earlier blocks sharing the first page are unusable until this holds.
+	if (!set_writable(start, start + BlockSlack, false)) {
+		flush();
+		return b;
+	}
+	b.Fn = reinterpret_cast<Code>(start);
+	Used = e.P - Buffer;
+	return b;
+}
+
+void Jit::check(const Chip8& c8, uint16_t pc, uint16_t count) {
+	for (uint16_t i = 0; i != count; ++i) { Shadow->emulate_cycle(); }
+
+	const Chip8& ref = *Shadow;
+	const bool   same =
+	    c8.V == ref.V && c8.I == ref.I && c8.PC == ref.PC && c8.SP == ref.SP &&
+	    c8.DT == ref.DT && c8.ST == ref.ST && c8.OC == ref.OC &&
+	    c8.Stack == ref.Stack && c8.Memory == ref.Memory &&
+	    c8.Display == ref.Display && c8.Rng == ref.Rng &&
+	    c8.Cycles == ref.Cycles;
+	if (!same) {
+		std::cerr << "JIT mismatch in block at " << std::hex << pc
+		          << ": PC " << c8.PC << " vs " << ref.PC << std::dec << "\n";
+		Diverged = true;
+	}
+}
+
+// Runs exactly n instructions. Blocks that don't fit in what's left of the
+// budget are interpreted one instruction at a time.
+uint64_t Jit::run(Chip8& c8, uint64_t n) {
+	uint64_t ran = 0;
+
+	// Blocks would bypass the tracer and the profiler, and only know CHIP-8.
+	bool interpret = Buffer == nullptr || c8.Trace != nullptr ||
+	                 c8.Variant != Mode::Chip8;
+#ifdef Profile
+	interpret |= c8.Prof != nullptr;
+#endif
+	if (interpret) {
+		for (; ran != n; ++ran) {
+			c8.emulate_cycle();
+			if (c8.Idle) { ran += c8.idle(n - ran - 1); }
+		}
+		return ran;
+	}
+	if (Check && !Shadow) { Shadow = std::make_unique<Chip8>(); }
+
+	while (ran != n && !Diverged) {
+		if (c8.CodeGen != Gen) {
+			flush();
+			Gen = c8.CodeGen;
+		}
+
+		const uint16_t pc = c8.PC;
+		if (pc >= 0xFFF) {
+			c8.emulate_cycle();
+			++ran;
+			if (c8.Idle) { ran += c8.idle(n - ran); }
+			continue;
+		}
+
+		const Block& b =
+		    Blocks[pc].Fn != nullptr ? Blocks[pc] : compile(c8, pc);
+		if (b.Fn == nullptr || b.Count > n - ran) {
+			c8.emulate_cycle();
+			++ran;
+			if (c8.Idle) { ran += c8.idle(n - ran); }
+			continue;
+		}
+
+		if (Check) { *Shadow = c8; }
+		b.Fn(&c8);
+		c8.Cycles += b.Count;
+		if (Check) { check(c8, pc, b.Count); }
+		ran += b.Count;
+
+		// Inlined jumps don't flag a jump to themselves or back over two
+		// instructions the way op_jp does.
+		const uint16_t last = pc + 2 * (b.Count - 1);
+		if (c8.Idle || c8.PC == last || c8.PC + 4 == last) {
+			ran += c8.idle(n - ran);
+		}
+	}
+	return ran;
+}
@@ -0,0 +1,50 @@
+#ifndef _C8E_JIT_HH_
+#define _C8E_JIT_HH_
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+#include "chip8.hh"
+
+// Basic-block recompiler for x86-64 Linux. Straight-line runs of instructions
+// ending at a jump, skip, call, DRW or memory store are translated to native
+// code and cached by start address. Simple register ops are emitted inline,
+// everything else calls the interpreter's handler. Elsewhere, or if the code
+// buffer can't be mapped, run() just interprets.
+//
+// A Jit belongs to one Chip8; its blocks are dropped whenever that machine's
+// CodeGen moves (self-modifying stores, ROM load, reset).
+struct Jit {
+	using Code = void (*)(Chip8*);
+
+	struct Block {
+		Code     Fn{};
+		uint16_t Count{};  // Instructions in the block
+	};
+
+	bool Check{};     // Re-run every block on the interpreter and compare
+	bool Diverged{};  // Check mode found a mismatch; run() stops
+
+	std::array<Block, 4096> Blocks{};
+	std::deque<Instr>       Operands;  // Stable copies handed to handlers
+	std::unique_ptr<Chip8>  Shadow;    // Check mode reference machine
+
+	uint8_t* Buffer{};
+	size_t   Used{};
+	uint32_t Gen{};
+
+	Jit();
+	~Jit();
+	Jit(const Jit&) = delete;
+	Jit& operator=(const Jit&) = delete;
+
+	uint64_t run(Chip8& c8, uint64_t n);
+	void     flush();
+
+private:
+	const Block& compile(Chip8& c8, uint16_t pc);
+	void         check(const Chip8& c8, uint16_t pc, uint16_t count);
+};
+#endif
@@ -0,0 +1,114 @@
+#include "library.hh"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "rom.hh"
+
+namespace fs = std::filesystem;
+
+bool RomLibrary::load_index(
+    std::unordered_map<std::string, Entry>& cached) const {
+	std::ifstream file(Dir + "/" + IndexName);
+	if (!file.is_open()) { return false; }
+
+	for (std::string line; std::getline(file, line);) {
+		if (line.empty() || line[0] == '#') { continue; }
+
+		std::istringstream is(line);
+		Entry              e;
+		is >> std::hex >> e.Hash >> std::dec >> e.Size >> e.MTime >> e.Quirks;
+		is.ignore(1);
+		std::getline(is, e.Name);
+		if (is.fail() || e.Name.empty()) { continue; }
+		cached[e.Name] = std::move(e);
+	}
+	return true;
+}
+
+bool RomLibrary::save_index() const {
+	std::ofstream file(Dir + "/" + IndexName);
+	file << "# hash size mtime quirks name\n";
+	for (const auto& e : Entries) {
+		file << std::hex << e.Hash << std::dec << " " << e.Size << " "
+		     << e.MTime << " " << e.Quirks << " " << e.Name << "\n";
+	}
+	return file.good();
+}
+
+// Loads the cached index for dir and brings it up to date, rewriting the
+// cache if anything changed. Files that aren't loadable ROMs are left out.
+bool RomLibrary::scan(const std::string& dir) {
+	Dir = dir;
+	Entries.clear();
+	ByHash.clear();
+
+	std::unordered_map<std::string, Entry> cached;
+	bool dirty = !load_index(cached);
+
+	std::error_code ec;
+	for (const auto& f : fs::directory_iterator(dir, ec)) {
+		const std::string name = f.path().filename().string();
+		if (name[0] == '.' || !f.is_regular_file()) { continue; }
+
+		Entry e;
+		e.Name  = name;
+		e.Size  = f.file_size();
+		e.MTime = f.last_write_time().time_since_epoch().count();
+
+		const auto it = cached.find(name);
+		if (it != cached.end() && it->second.Size == e.Size &&
+		    it->second.MTime == e.MTime) {
+			Entries.push_back(std::move(it->second));
+			cached.erase(it);
+			continue;
+		}
+
+		Rom rom;
+		if (rom.open(f.path().c_str(), Rom::MaxXOSize) != LoadError::None) {
+			continue;
+		}
+		e.Hash = rom.Hash;
+		if (it != cached.end() && it->second.Hash == e.Hash) {
+			e.Quirks = it->second.Quirks;
+		}
+		if (it != cached.end()) { cached.erase(it); }
+		Entries.push_back(std::move(e));
+		dirty = true;
+	}
+	if (ec) { return false; }
+	dirty |= !cached.empty();  // Files that went away
+
+	sort_entries();
+	return !dirty || save_index();
+}
+
+// Reads the cached index for dir as it stands, without looking at the files
+// or writing anything. Lookups go by content hash, so a stale entry can't
+// name the wrong ROM. False if dir has no index.
+bool RomLibrary::load(const std::string& dir) {
+	Dir = dir;
+	Entries.clear();
+	ByHash.clear();
+
+	std::unordered_map<std::string, Entry> cached;
+	if (!load_index(cached)) { return false; }
+	for (auto& [name, e] : cached) { Entries.push_back(std::move(e)); }
+	sort_entries();
+	return true;
+}
+
+void RomLibrary::sort_entries() {
+	std::sort(Entries.begin(), Entries.end(),
+	          [](const Entry& a, const Entry& b) { return a.Name < b.Name; });
+	for (size_t i = 0; i != Entries.size(); ++i) {
+		ByHash.emplace(Entries[i].Hash, i);
+	}
+}
+
+const RomLibrary::Entry* RomLibrary::find(uint64_t hash) const {
+	const auto it = ByHash.find(hash);
+	return it != ByHash.end() ? &Entries[it->second] : nullptr;
+}
@@ -0,0 +1,46 @@
+#ifndef _C8E_LIBRARY_HH_
+#define _C8E_LIBRARY_HH_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Index of the ROMs in one directory, keyed by content hash and cached in
+// <dir>/.c8index. A rescan only opens files whose size or modification time
+// changed, so starting a batch over a large set costs one stat per file.
+//
+// The cache is plain text, one ROM per line:
+//
+//   hash size mtime quirks name
+//
+// Quirks names the compatibility profile to run the ROM with: default, vip,
+// chip48, schip or xochip ("default" unless edited). It is kept across
+// rescans for as long as the hash matches.
+struct RomLibrary {
+	static constexpr const char* IndexName = ".c8index";
+
+	struct Entry {
+		uint64_t    Hash{};
+		uint32_t    Size{};
+		int64_t     MTime{};
+		std::string Quirks{"default"};
+		std::string Name;  // File name within the directory
+	};
+
+	std::string        Dir;
+	std::vector<Entry> Entries;  // Sorted by name
+
+	bool         scan(const std::string& dir);
+	bool         load(const std::string& dir);
+	const Entry* find(uint64_t hash) const;
+	std::string  path(const Entry& e) const { return Dir + "/" + e.Name; }
+
+private:
+	std::unordered_map<uint64_t, size_t> ByHash;
+
+	bool load_index(std::unordered_map<std::string, Entry>& cached) const;
+	bool save_index() const;
+	void sort_entries();
+};
+#endif
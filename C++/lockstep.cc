@@ -0,0 +1,119 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "batch.hh"
+#include "chip8.hh"
+
+// Runs one ROM on N lanes twice, once as N scalar Chip8 loops and once as a
+// lockstep Batch, with the same per-lane key streams and seeds. Reports the
+// throughput of both and checks the final states agree.
+
+namespace {
+void usage(const char* prog) {
+	std::cerr << "usage: " << prog
+	          << " [-n lanes] [-f frames] [-r ips] [-s seed] rom\n";
+}
+
+// Deterministic per-lane input: a new key mask every few frames.
+uint16_t keys_for(size_t lane, uint64_t frame) {
+	uint32_t x = (lane + 1) * 0x9E3779B9U ^ (frame / 8) * 0x85EBCA6BU;
+	x ^= x >> 15, x *= 0x2C1B3C6DU, x ^= x >> 12;
+	return (x & 0xF) == 0 ? 1U << (x >> 4 & 0xF) : 0;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+	                                     start)
+	    .count();
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+	const char* romPath = nullptr;
+	size_t      lanes   = 256;
+	uint64_t    frames  = 600;
+	uint32_t    rate    = 1000;
+	uint32_t    seed    = 1;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		if (arg == "-n" && i + 1 < argc) {
+			lanes = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "-f" && i + 1 < argc) {
+			frames = std::strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "-r" && i + 1 < argc) {
+			rate = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "-s" && i + 1 < argc) {
+			seed = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg[0] == '-') {
+			usage(argv[0]);
+			return -1;
+		} else {
+			romPath = argv[i];
+		}
+	}
+	if (romPath == nullptr || lanes == 0 || rate < 60) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	Rom rom;
+	if (const LoadError err = rom.open(romPath); err != LoadError::None) {
+		std::cerr << romPath << ": " << describe(err) << "\n";
+		return -1;
+	}
+
+	std::vector<Chip8> scalar(lanes);
+	for (size_t i = 0; i != lanes; ++i) {
+		scalar[i].init_or_reset();
+		scalar[i].seed(seed + i);
+		scalar[i].load_rom(rom);
+	}
+	Batch batch(scalar);
+
+	const uint64_t perFrame = rate / 60;
+	const uint64_t total    = perFrame * frames * lanes;
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i != lanes; ++i) {
+		Chip8& c8 = scalar[i];
+		for (uint64_t f = 0; f != frames; ++f) {
+			const uint16_t keys = keys_for(i, f);
+			for (uint8_t k = 0; k != 16; ++k) { c8.Key[k] = (keys >> k) & 1; }
+			for (uint64_t n = 0; n != perFrame; ++n) { c8.emulate_cycle(); }
+			c8.tick_timers();
+		}
+	}
+	const double scalarTime = seconds_since(start);
+
+	start = std::chrono::steady_clock::now();
+	for (uint64_t f = 0; f != frames; ++f) {
+		for (size_t i = 0; i != lanes; ++i) { batch.Keys[i] = keys_for(i, f); }
+		for (uint64_t n = 0; n != perFrame; ++n) { batch.step(); }
+		batch.tick_timers();
+	}
+	const double batchTime = seconds_since(start);
+
+	size_t mismatches = 0;
+	Chip8  out;
+	for (size_t i = 0; i != lanes; ++i) {
+		batch.store(i, out);
+		const Chip8& ref = scalar[i];
+		mismatches += out.V != ref.V || out.PC != ref.PC || out.I != ref.I ||
+		              out.SP != ref.SP || out.DT != ref.DT ||
+		              out.Stack != ref.Stack || out.Display != ref.Display ||
+		              out.Memory != ref.Memory || out.Rng != ref.Rng;
+	}
+
+	const double steps = batch.Uniform + batch.Divergent;
+	std::cout << "lanes " << lanes << ", " << total << " instructions\n"
+	          << "scalar   " << total / scalarTime / 1e6 << " M ins/s\n"
+	          << "lockstep " << total / batchTime / 1e6 << " M ins/s ("
+	          << scalarTime / batchTime << "x, " << 100 * batch.Uniform / steps
+	          << "% uniform steps)\n"
+	          << "mismatched lanes " << mismatches << "\n";
+	return mismatches == 0 ? 0 : 1;
+}
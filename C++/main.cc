@@ -1,71 +1,380 @@
 #include <SDL2/SDL.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
+#include "audio.hh"
 #include "chip8.hh"
+#include "inputlog.hh"
+#include "jit.hh"
+#include "library.hh"
+#include "rewind.hh"
+#include "scheduler.hh"
+#include "spsc.hh"
+#include "trace.hh"
+#include "video.hh"
+
+namespace {
+// A finished display, handed from the emulation thread to the renderer.
+struct Frame {
+	std::array<Chip8::Plane, 2> Display;
+	bool                        HiRes;
+};
+
+// What the main thread forwards from SDL to the emulation thread.
+struct Input {
+	enum class Kind : uint8_t { Key, Rewind, Save, Load, Trace, Turbo };
+
+	Kind    What;
+	uint8_t Key;  // Kind::Key only
+	bool    Down;
+};
+}  // namespace
 
 int main(int argc, char *argv[]) {
-	if (argc != 2) { return -1; }
+	const char* romPath   = nullptr;
+	const char* logPath   = nullptr;
+	const char* tracePath = nullptr;
+	uint32_t    seed      = std::time(nullptr);
+	Mode        mode      = Mode::Chip8;
+	const char* quirks    = nullptr;
+	bool        badMode   = false;
+	bool        turbo     = false;
+	uint32_t    frameSkip = 1;
+	Scheduler   sched;
+	Jit         jit;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		if (arg == "-r" && i + 1 < argc) {
+			sched.Rate = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "-s" && i + 1 < argc) {
+			seed = std::strtoul(argv[++i], nullptr, 10);
+		} else if (arg == "-R" && i + 1 < argc) {
+			logPath = argv[++i];
+		} else if (arg == "-T" && i + 1 < argc) {
+			tracePath = argv[++i];
+		} else if (arg == "-m" && i + 1 < argc) {
+			badMode |= !parse_mode(argv[++i], mode);
+		} else if (arg == "-q" && i + 1 < argc) {
+			quirks = argv[++i];
+		} else if (arg == "-j") {
+			sched.Recompiler = &jit;
+		} else if (arg == "-f") {
+			turbo = true;
+		} else if (arg == "-k" && i + 1 < argc) {
+			frameSkip = std::max(1UL, std::strtoul(argv[++i], nullptr, 10));
+		} else {
+			romPath = argv[i];
+		}
+	}
+	if (romPath == nullptr || badMode ||
+	    (logPath != nullptr && sched.Rate == 0)) {
+		std::cerr << "usage: " << argv[0]
+		          << " [-r ips|0] [-s seed] [-j] [-f] [-k n]"
+		             " [-m chip8|schip|xochip] [-q quirks] [-R inputlog]"
+		             " [-T trace] rom\n";
+		return -1;
+	}
 
 	bool               isRunning = true;
 	constexpr uint16_t scrWidth  = 1280;
 	constexpr uint16_t scrHeight = 640;
-	constexpr uint8_t  pixPerRow = 64;
-	constexpr uint8_t  pixPerCol = 32;
 
-	SDL_Window*  pwin    = nullptr;
-	SDL_Renderer* pren   = nullptr;
-	SDL_Texture* pscrTxr = nullptr;
+	SDL_Window*   pwin = nullptr;
+	SDL_Renderer* pren = nullptr;
 	SDL_Event     event;
 
+	// Window-sized RGBA texture, scaled up on the CPU: 10x for high-res
+	// frames, 20x for low-res.
+	SDL_Texture*          screen = nullptr;
+	std::vector<uint32_t> pixels(scrWidth * scrHeight);
+
 	constexpr std::array<uint8_t, 16> keyMap{
 	    SDLK_x, SDLK_1, SDLK_2, SDLK_3, SDLK_q, SDLK_w, SDLK_e, SDLK_a,
 	    SDLK_s, SDLK_d, SDLK_z, SDLK_c, SDLK_4, SDLK_r, SDLK_r, SDLK_v};
 
-	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
 	pwin = SDL_CreateWindow("C8E", SDL_WINDOWPOS_UNDEFINED,
 	                        SDL_WINDOWPOS_UNDEFINED, scrWidth, scrHeight,
 	                        SDL_WINDOW_INPUT_FOCUS);
 	pren = SDL_CreateRenderer(
 	    pwin, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 
-	SDL_RenderSetLogicalSize(pren, pixPerRow, pixPerCol);
-	pscrTxr =
-	    SDL_CreateTexture(pren, SDL_PIXELFORMAT_RGB332,
-	                      SDL_TEXTUREACCESS_STREAMING, pixPerRow, pixPerCol);
+	screen = SDL_CreateTexture(pren, SDL_PIXELFORMAT_RGBA8888,
+	                           SDL_TEXTUREACCESS_STREAMING, scrWidth,
+	                           scrHeight);
 
 	// Chip8
 	Chip8 c8;
+	c8.set_mode(mode);
+	c8.seed(seed);
 	c8.init_or_reset();
-	c8.load_rom(argv[1]);
+	if (const LoadError err = c8.load_rom(romPath); err != LoadError::None) {
+		std::cerr << romPath << ": " << describe(err) << "\n";
+		return -1;
+	}
+
+	// Without -q the quirk profile comes from the index of the ROM's
+	// directory, if there is one with this ROM in it. The index is only
+	// read; C8E-headless builds it when run over the directory.
+	std::string profile = quirks != nullptr ? quirks : "default";
+	if (quirks == nullptr) {
+		const std::filesystem::path dir =
+		    std::filesystem::path(romPath).parent_path();
+		RomLibrary lib;
+		lib.load(dir.empty() ? "." : dir.string());
+		if (const auto* e = lib.find(c8.RomHash)) { profile = e->Quirks; }
+	}
+	Quirks profileQuirks;
+	if (!parse_quirks(profile.c_str(), profileQuirks)) {
+		std::cerr << "unknown quirk profile " << profile << "\n";
+		return -1;
+	}
+	c8.set_quirks(profileQuirks);
+
+	// The device pulls from its own thread; the scheduler pushes the sound
+	// state each timer tick. No device just means no sound.
+	Audio         audio;
+	SDL_AudioSpec want{};
+	want.freq     = Audio::SampleRate;
+	want.format   = AUDIO_S16SYS;
+	want.channels = 1;
+	want.samples  = 512;
+	want.userdata = &audio;
+	want.callback = [](void* user, Uint8* stream, int len) {
+		static_cast<Audio*>(user)->render(reinterpret_cast<int16_t*>(stream),
+		                                  len / sizeof(int16_t));
+	};
+	const SDL_AudioDeviceID sound =
+	    SDL_OpenAudioDevice(nullptr, 0, &want, nullptr, 0);
+	if (sound == 0) {
+		std::cerr << "no audio: " << SDL_GetError() << "\n";
+	} else {
+		sched.Sound = &audio;
+		SDL_PauseAudioDevice(sound, 0);
+	}
+
+	// Recording needs one unbroken timeline, so rewind and quick load are
+	// off while it runs.
+	InputRecorder recorder;
+	if (logPath != nullptr && !recorder.open(logPath, c8, sched.Rate)) {
+		std::cerr << "can't write input log to " << logPath << "\n";
+		return -1;
+	}
+	const bool recording = logPath != nullptr;
+
+	// The last 2^20 instructions, written out on F12 and at exit.
+	std::unique_ptr<Tracer> trace;
+	if (tracePath != nullptr) {
+		trace    = std::make_unique<Tracer>();
+		c8.Trace = trace.get();
+	}
+
+	// Backspace rewinds while held, F5/F9 quick save/load next to the ROM.
+	Rewind            rewind;
+	const std::string statePath = std::string(romPath) + ".state";
+
+	// The machine runs on its own thread, so a slow present never holds up
+	// the CPU. Input reaches it through a queue; finished frames come back
+	// through a triple buffer, newest only.
+	std::atomic<bool>     running{true};
+	std::atomic<uint64_t> ticks{};  // sched.Ticks, for the speed readout
+	SpscRing<Input, 256>  inputs;
+	TripleBuffer<Frame>   frames;
+
+	std::thread emulation([&] {
+		// Tab held (or -f) fast-forwards; only one turbo frame in frameSkip
+		// is published.
+		bool     rewinding = false;
+		bool     tabHeld   = false;
+		uint32_t skipped   = 0;
+
+		sched.start();
+		while (running.load(std::memory_order_relaxed)) {
+			for (Input in; inputs.pop(in);) {
+				switch (in.What) {
+					case Input::Kind::Key: c8.Key.at(in.Key) = in.Down; break;
+					case Input::Kind::Rewind:
+						if (recording) { break; }
+						rewinding = in.Down;
+						if (!in.Down) { sched.start(); }
+						break;
+					case Input::Kind::Save:
+						c8.save_state(statePath.c_str());
+						break;
+					case Input::Kind::Load:
+						if (!recording && !c8.load_state(statePath.c_str())) {
+							std::cerr << "no usable state in " << statePath
+							          << "\n";
+						}
+						break;
+					case Input::Kind::Trace:
+						if (trace) { trace->save(tracePath); }
+						break;
+					case Input::Kind::Turbo: tabHeld = in.Down; break;
+				}
+			}
+			recorder.record(c8);
+
+			sched.Turbo = turbo != tabHeld;
+			if (rewinding) {
+				if (!rewind.step_back(c8)) {
+					rewinding = false;
+					sched.start();
+				}
+			} else if (sched.run_frame(c8) != 0) {
+				rewind.push(c8);
+			}
+			ticks.store(sched.Ticks, std::memory_order_relaxed);
+
+			// Skipped turbo frames keep their dirty rows for the next one.
+			if (c8.DirtyRows != 0 && (!sched.Turbo || ++skipped >= frameSkip)) {
+				Frame& f  = frames.back();
+				f.Display = c8.Display;
+				f.HiRes   = c8.HiRes;
+				frames.publish();
+				c8.DirtyRows = 0;
+				skipped      = 0;
+			}
+
+			// Sleep off the rest of the tick unless running unthrottled with
+			// work to do. A key wait or halt only ends on input. A timer wait
+			// only needs the clock when the timers follow it; turbo ticks them
+			// with the instructions. Rewind steps back one tick at a time.
+			const Wait blocked = sched.Blocked;
+			if (rewinding) {
+				std::this_thread::sleep_for(Scheduler::Tick{1});
+			} else if ((sched.Rate != 0 && !sched.Turbo) ||
+			           blocked == Wait::Key || blocked == Wait::Halt ||
+			           (blocked == Wait::Timer && sched.Rate == 0)) {
+				std::this_thread::sleep_until(sched.next_tick());
+			}
+		}
+	});
+
+	// A full queue only happens if the emulation thread is stuck in a long
+	// turbo slice; wait for it rather than lose a key release.
+	const auto send = [&](Input in) {
+		while (!inputs.push(in)) { std::this_thread::yield(); }
+	};
+
+	// The title shows the speed against 60 timer ticks a second.
+	auto     lastReadout = std::chrono::steady_clock::now();
+	uint64_t lastTicks   = 0;
+
+	// The last frame uploaded, to find the rows the next one changes.
+	Frame shown{};
+	bool  haveShown = false;
 
 	while (isRunning) {
 		while (SDL_PollEvent(&event) != 0) {
-			if (event.type == SDL_KEYDOWN &&
-			    event.key.keysym.sym == SDLK_ESCAPE) {
-				isRunning = false;
+			if (event.type != SDL_KEYDOWN && event.type != SDL_KEYUP) {
+				continue;
+			}
+			const bool down = event.type == SDL_KEYDOWN;
+			switch (event.key.keysym.sym) {
+				case SDLK_ESCAPE:
+					if (down) { isRunning = false; }
+					break;
+				case SDLK_BACKSPACE:
+					send({Input::Kind::Rewind, 0, down});
+					break;
+				case SDLK_F5:
+					if (down) { send({Input::Kind::Save, 0, down}); }
+					break;
+				case SDLK_F9:
+					if (down) { send({Input::Kind::Load, 0, down}); }
+					break;
+				case SDLK_F12:
+					if (down) { send({Input::Kind::Trace, 0, down}); }
+					break;
+				case SDLK_TAB: send({Input::Kind::Turbo, 0, down}); break;
+				default: break;
 			}
 			for (uint8_t i = 0; i != 16; ++i) {
 				if (event.key.keysym.sym == keyMap.at(i)) {
-					if (event.type == SDL_KEYDOWN) {
-						c8.Key.at(i) = 1;
-					} else {
-						c8.Key.at(i) = 0;
-					}
+					send({Input::Kind::Key, i, down});
 				}
 			}
 		}
 
-		c8.emulate_cycle();
-		SDL_UpdateTexture(pscrTxr, nullptr, static_cast<void *>(&c8.Display),
-		                  64 * sizeof(uint8_t));
+		const auto now = std::chrono::steady_clock::now();
+		if (now - lastReadout >= std::chrono::seconds(1)) {
+			const uint64_t t = ticks.load(std::memory_order_relaxed);
+			const std::chrono::duration<double> took = now - lastReadout;
+			const double speed =
+			    (t - lastTicks) / (took.count() * Scheduler::TimerHz);
+			char title[32];
+			std::snprintf(title, sizeof(title), "C8E %.1fx", speed);
+			SDL_SetWindowTitle(pwin, title);
+			lastReadout = now;
+			lastTicks   = t;
+		}
+
+		// Nothing new: wait for input, briefly, instead of spinning.
+		if (!frames.update()) {
+			SDL_WaitEventTimeout(nullptr, 1);
+			continue;
+		}
+		const Frame& f = frames.front();
+
+		// Expand and upload only the rows that changed since the last frame
+		// shown; all of them after a resolution switch.
+		const int width  = f.HiRes ? 128 : 64;
+		const int height = f.HiRes ? 64 : 32;
+		int       top    = height;
+		int       bottom = -1;
+		for (int y = 0; y != height; ++y) {
+			bool changed = !haveShown || f.HiRes != shown.HiRes;
+			for (int p = 0; p != 2; ++p) {
+				changed |= f.Display[p][y] != shown.Display[p][y] ||
+				           f.Display[p][64 + y] != shown.Display[p][64 + y];
+			}
+			if (changed) {
+				top    = std::min(top, y);
+				bottom = y;
+			}
+		}
+		if (top <= bottom) {
+			const int scale = scrWidth / width;
+			uint32_t* first = &pixels[top * scale * scrWidth];
+			render_rows(f.Display, f.HiRes, scale, DefaultPalette, top, bottom,
+			            first, scrWidth);
+			const SDL_Rect dirty{0, top * scale, scrWidth,
+			                     (bottom - top + 1) * scale};
+			SDL_UpdateTexture(screen, &dirty, first,
+			                  scrWidth * sizeof(uint32_t));
+		}
+		shown     = f;
+		haveShown = true;
+
 		SDL_RenderClear(pren);
-		SDL_RenderCopy(pren, pscrTxr, nullptr, nullptr);
+		SDL_RenderCopy(pren, screen, nullptr, nullptr);
 		SDL_RenderPresent(pren);
 	}
 
-	SDL_DestroyTexture(pscrTxr);
+	running = false;
+	emulation.join();
+
+	if (trace && !trace->save(tracePath)) {
+		std::cerr << "can't write trace to " << tracePath << "\n";
+	}
+
+	if (sound != 0) { SDL_CloseAudioDevice(sound); }
+	SDL_DestroyTexture(screen);
 	SDL_DestroyRenderer(pren);
 	SDL_DestroyWindow(pwin);
 	SDL_Quit();
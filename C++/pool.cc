@@ -0,0 +1,53 @@
+#include "pool.hh"
+
+#include <algorithm>
+#include <thread>
+
+Pool::Pool(unsigned threads) : Threads(threads) {
+	if (Threads == 0) {
+		Threads = std::max(1U, std::thread::hardware_concurrency());
+	}
+}
+
+bool Pool::take(std::vector<Queue>& queues, unsigned self, size_t& job) {
+	{
+		Queue&                      own = queues[self];
+		std::lock_guard<std::mutex> lock(own.Lock);
+		if (!own.Jobs.empty()) {
+			job = own.Jobs.back();
+			own.Jobs.pop_back();
+			return true;
+		}
+	}
+	for (unsigned i = 1; i != queues.size(); ++i) {
+		Queue&                      victim = queues[(self + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(victim.Lock);
+		if (!victim.Jobs.empty()) {
+			job = victim.Jobs.front();
+			victim.Jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+// Calls fn(i) once for every i in [0, jobs) and returns when all are done.
+// Jobs never enqueue more work, so a worker that finds every queue empty can
+// simply exit.
+void Pool::run(size_t jobs, const std::function<void(size_t)>& fn) {
+	const unsigned workers =
+	    std::min<size_t>(Threads, std::max<size_t>(jobs, 1));
+
+	std::vector<Queue> queues(workers);
+	for (size_t i = 0; i != jobs; ++i) {
+		queues[i * workers / jobs].Jobs.push_back(i);
+	}
+
+	std::vector<std::thread> threads;
+	for (unsigned w = 0; w != workers; ++w) {
+		threads.emplace_back([&, w] {
+			for (size_t job; take(queues, w, job);) { fn(job); }
+		});
+	}
+	for (auto& t : threads) { t.join(); }
+}
@@ -0,0 +1,29 @@
+#ifndef _C8E_POOL_HH_
+#define _C8E_POOL_HH_
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Work-stealing pool for running many independent jobs (typically one Chip8
+// each) across all cores. Every worker starts with a contiguous share of the
+// job indices, takes from the back of its own deque and steals from the front
+// of the others' once it runs dry, so uneven jobs still spread evenly.
+struct Pool {
+	unsigned Threads;
+
+	explicit Pool(unsigned threads = 0);
+
+	void run(size_t jobs, const std::function<void(size_t)>& fn);
+
+private:
+	struct Queue {
+		std::mutex         Lock;
+		std::deque<size_t> Jobs;
+	};
+
+	bool take(std::vector<Queue>& queues, unsigned self, size_t& job);
+};
+#endif
@@ -0,0 +1,210 @@
+#include "profiler.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <numeric>
+#include <string>
+
+namespace {
+constexpr std::array<const char*, Profiler::Classes> Names{
+    "00E0 CLS",  "00EE RET",  "0NNN SYS",  "1NNN JP",   "2NNN CALL",
+    "3XNN SE",   "4XNN SNE",  "5XY0 SE",   "6XNN LD",   "7XNN ADD",
+    "8XY0 LD",   "8XY1 OR",   "8XY2 AND",  "8XY3 XOR",  "8XY4 ADD",
+    "8XY5 SUB",  "8XY6 SHR",  "8XY7 SUBN", "8XYE SHL",  "9XY0 SNE",
+    "ANNN LD I", "BNNN JP",   "CXNN RND",  "DXYN DRW",  "EX9E SKP",
+    "EXA1 SKNP", "FX07 LD",   "FX0A LD K", "FX15 LD",   "FX18 LD",
+    "FX1E ADD",  "FX29 LD F", "FX33 BCD",  "FX55 LD",   "FX65 LD",
+    "00CN SCD",   "00DN SCU",   "00FB SCR",   "00FC SCL",
+    "00FD EXIT",  "00FE LOW",   "00FF HIGH",  "5XY2 SAVE",
+    "5XY3 LOAD",  "F000 LD I",  "FN01 PLANE", "F002 AUDIO",
+    "FX30 LD HF", "FX3A PITCH", "FX75 LD R",  "FX85 LD R",
+    "unknown"};
+
+constexpr uint8_t Unknown = Profiler::Classes - 1;
+
+// Indices of a sorted view over counts, largest first, zeros dropped.
+template <size_t N>
+std::vector<size_t> ranked(const std::array<uint64_t, N>& counts,
+                           size_t top) {
+	std::vector<size_t> order(N);
+	std::iota(order.begin(), order.end(), 0);
+	order.erase(std::remove_if(order.begin(), order.end(),
+	                           [&](size_t i) { return counts[i] == 0; }),
+	            order.end());
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return counts[a] > counts[b];
+	});
+	if (order.size() > top) { order.resize(top); }
+	return order;
+}
+}  // namespace
+
+// Opcodes outside mode's instruction set go by their CHIP-8 meaning, as in
+// Chip8::decode.
+uint8_t Profiler::op_class(uint16_t oc, Mode mode) {
+	const uint8_t nn    = oc & 0xFF;
+	const bool    schip = mode != Mode::Chip8;
+	const bool    xo    = mode == Mode::XOChip;
+	switch (oc >> 12) {
+		case 0x0:
+			if (oc == 0x00E0 || oc == 0x00EE) { return oc == 0x00E0 ? 0 : 1; }
+			if (schip && nn >= 0xFB) { return 37 + (nn - 0xFB); }
+			if (schip && (nn & 0xF0) == 0xC0) { return 35; }
+			if (xo && (nn & 0xF0) == 0xD0) { return 36; }
+			return 2;
+		case 0x5:
+			if (xo && (oc & 0xF) == 0x2) { return 42; }
+			if (xo && (oc & 0xF) == 0x3) { return 43; }
+			return 7;
+		case 0x8:
+			if ((oc & 0xF) <= 0x7) { return 10 + (oc & 0xF); }
+			return (oc & 0xF) == 0xE ? 18 : Unknown;
+		case 0xE: return nn == 0x9E ? 24 : nn == 0xA1 ? 25 : Unknown;
+		case 0xF:
+			switch (nn) {
+				case 0x07: return 26;
+				case 0x0A: return 27;
+				case 0x15: return 28;
+				case 0x18: return 29;
+				case 0x1E: return 30;
+				case 0x29: return 31;
+				case 0x33: return 32;
+				case 0x55: return 33;
+				case 0x65: return 34;
+				case 0x00: return xo && oc == 0xF000 ? 44 : Unknown;
+				case 0x01: return xo ? 45 : Unknown;
+				case 0x02: return xo && oc == 0xF002 ? 46 : Unknown;
+				case 0x30: return schip ? 47 : Unknown;
+				case 0x3A: return xo ? 48 : Unknown;
+				case 0x75: return schip ? 49 : Unknown;
+				case 0x85: return schip ? 50 : Unknown;
+				default: return Unknown;
+			}
+		default: return (oc >> 12) < 0x9 ? 2 + (oc >> 12) : 10 + (oc >> 12);
+	}
+}
+
+const char* Profiler::class_name(uint8_t cls) {
+	return Names[std::min<size_t>(cls, Unknown)];
+}
+
+// TSC on x86-64, which is cheap enough to read around every instruction;
+// nanoseconds elsewhere.
+uint64_t Profiler::ticks() {
+#if defined(__x86_64__)
+	return __builtin_ia32_rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	           std::chrono::steady_clock::now().time_since_epoch())
+	    .count();
+#endif
+}
+
+void Profiler::enter(uint16_t entry) {
+	const uint64_t key = uint64_t{Current} << 16 | entry;
+	const auto     it  = Children.find(key);
+	if (it != Children.end()) {
+		Current = it->second;
+		return;
+	}
+	Nodes.push_back({Current, entry});
+	Current = Children[key] = Nodes.size() - 1;
+}
+
+// Executes in on c8 and accounts for it. The class comes from c8.OC after
+// the fact since a not yet decoded entry only learns its opcode as it runs.
+void Profiler::run(Chip8& c8, const Instr& in) {
+	const uint16_t pc = c8.PC & 0xFFF;
+
+	const uint64_t start = ticks();
+	in.Fn(c8, in);
+	const uint64_t spent = ticks() - start;
+
+	const uint8_t cls = op_class(c8.OC, c8.Variant);
+	ClassTicks[cls] += spent;
+	++ClassCount[cls];
+	++PcCount[pc];
+	PcOpcode[pc] = c8.OC;
+	++Nodes[Current].Self;
+
+	// Control going backwards (or staying put, for spins and FX0A) closes a
+	// loop. Returns go backwards too but aren't loops.
+	if (cls != 1 && c8.PC <= pc) { ++Loops[uint32_t{pc} << 12 | c8.PC]; }
+
+	// Past MaxDepth calls are only counted so returns still pair up.
+	if (cls == 4) {
+		if (Depth++ < MaxDepth) { enter(c8.OC & 0xFFF); }
+		MaxSeen = std::max(MaxSeen, Depth);
+	} else if (cls == 1 && Depth != 0) {
+		if (Depth-- <= MaxDepth) { Current = Nodes[Current].Parent; }
+	}
+}
+
+void Profiler::report(std::ostream& os, size_t top) const {
+	const uint64_t total =
+	    std::accumulate(ClassCount.begin(), ClassCount.end(), uint64_t{});
+	const uint64_t totalTicks =
+	    std::accumulate(ClassTicks.begin(), ClassTicks.end(), uint64_t{});
+	if (total == 0) { return; }
+
+	auto pct = [](uint64_t n, uint64_t of) { return 100.0 * n / of; };
+
+	const auto flags = os.flags();
+	const char fill  = os.fill(' ');
+	os << std::fixed << std::setprecision(2);
+	os << total << " instructions, max call depth " << MaxSeen << "\n\n";
+
+	os << "by opcode            count       %   ticks %  ticks/ins\n";
+	for (auto c : ranked(ClassCount, Classes)) {
+		os << std::left << std::setw(12) << Names[c] << std::right
+		   << std::setw(14) << ClassCount[c] << std::setw(8)
+		   << pct(ClassCount[c], total) << std::setw(10)
+		   << pct(ClassTicks[c], totalTicks) << std::setw(11)
+		   << double(ClassTicks[c]) / ClassCount[c] << "\n";
+	}
+
+	os << "\nby address  opcode          count       %\n" << std::hex;
+	for (auto pc : ranked(PcCount, top)) {
+		os << std::uppercase << std::setfill('0') << "  " << std::setw(3) << pc
+		   << "       " << std::setw(4) << PcOpcode[pc] << std::setfill(' ')
+		   << std::dec << std::setw(15) << PcCount[pc] << std::setw(8)
+		   << pct(PcCount[pc], total) << "\n"
+		   << std::hex;
+	}
+
+	std::vector<std::pair<uint32_t, uint64_t>> loops(Loops.begin(),
+	                                                 Loops.end());
+	std::sort(loops.begin(), loops.end(),
+	          [](auto& a, auto& b) { return a.second > b.second; });
+	if (loops.size() > top) { loops.resize(top); }
+
+	os << "\nhot loops   from -> to   iterations\n";
+	for (const auto& [edge, count] : loops) {
+		os << "            " << std::setfill('0') << std::setw(3)
+		   << (edge >> 12) << " -> " << std::setw(3) << (edge & 0xFFF)
+		   << std::setfill(' ') << std::dec << std::setw(13) << count << "\n"
+		   << std::hex;
+	}
+	os.flags(flags);
+	os.fill(fill);
+}
+
+// One line per call stack: "main;sub_2A4;sub_31C <instructions>".
+void Profiler::write_folded(std::ostream& os) const {
+	std::vector<uint16_t> path;
+	for (uint32_t n = 0; n != Nodes.size(); ++n) {
+		if (Nodes[n].Self == 0) { continue; }
+
+		path.clear();
+		for (uint32_t i = n; i != 0; i = Nodes[i].Parent) {
+			path.push_back(Nodes[i].Entry);
+		}
+		os << "main";
+		for (auto it = path.rbegin(); it != path.rend(); ++it) {
+			os << ";sub_" << std::hex << std::uppercase << *it << std::dec
+			   << std::nouppercase;
+		}
+		os << " " << Nodes[n].Self << "\n";
+	}
+}
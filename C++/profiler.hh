@@ -0,0 +1,53 @@
+#ifndef _C8E_PROFILER_HH_
+#define _C8E_PROFILER_HH_
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "chip8.hh"
+
+// Execution profile of one machine, filled in by Chip8::emulate_cycle when
+// built with -DProfile and Chip8::Prof is set. Counts instructions and host
+// time per opcode class and per address, backward jumps (loops), and
+// instructions per call stack, which is written out in the folded format
+// flamegraph.pl reads.
+struct Profiler {
+	static constexpr size_t Classes  = 52;  // Last one is unknown opcodes
+	static constexpr size_t MaxDepth = 64;
+
+	struct Node {
+		uint32_t Parent;
+		uint16_t Entry;  // Call target, 0x200 for the root
+		uint64_t Self{};
+	};
+
+	std::array<uint64_t, Classes> ClassCount{};
+	std::array<uint64_t, Classes> ClassTicks{};  // Host clock, see ticks()
+	std::array<uint64_t, 4096>    PcCount{};
+	std::array<uint16_t, 4096>    PcOpcode{};  // Last opcode seen there
+
+	std::unordered_map<uint32_t, uint64_t> Loops;  // from << 12 | to
+
+	// Call tree, interned so each instruction only bumps one counter.
+	std::vector<Node>                      Nodes{{0, 0x200}};
+	std::unordered_map<uint64_t, uint32_t> Children;  // parent << 16 | entry
+	uint32_t                               Current{};
+	uint32_t                               Depth{};
+	uint32_t                               MaxSeen{};
+
+	void run(Chip8& c8, const Instr& in);
+
+	void report(std::ostream& os, size_t top = 20) const;
+	void write_folded(std::ostream& os) const;
+
+	static uint8_t     op_class(uint16_t oc, Mode mode = Mode::Chip8);
+	static const char* class_name(uint8_t cls);
+
+private:
+	static uint64_t ticks();
+	void            enter(uint16_t entry);
+};
+#endif
@@ -0,0 +1,57 @@
+#include "rewind.hh"
+
+#include <algorithm>
+#include <cstring>
+
+Rewind::Rewind(size_t frames) : Ring(frames) {}
+
+// Records c8 as the newest entry. When the ring is full the oldest entry is
+// overwritten. Only the part of the state the mode uses is compared, so a
+// CHIP-8 frame looks at 4 KB of memory, not 64. A state loaded in another
+// mode starts the history over.
+void Rewind::push(const Chip8& c8) {
+	c8.save_state(Scratch);
+	if (c8.state_size() != Size) {
+		Size  = c8.state_size();
+		Count = 0;
+	}
+
+	Entry& e = Ring[Head];
+	e.Changed.clear();
+	e.Undo.clear();
+
+	if (Count != 0) {
+		for (size_t off = 0; off < Size; off += PageSize) {
+			const size_t len = std::min(PageSize, Size - off);
+			if (std::memcmp(&Prev[off], &Scratch[off], len) == 0) { continue; }
+			e.Changed.push_back(off / PageSize);
+			e.Undo.insert(e.Undo.end(), &Prev[off], &Prev[off] + len);
+		}
+	}
+	std::copy_n(Scratch.begin(), Size, Prev.begin());
+
+	Head = (Head + 1) % Ring.size();
+	Count = std::min(Count + 1, Ring.size());
+}
+
+// Restores the newest entry and drops it, so repeated calls walk back one
+// frame at a time. Returns false once the history is used up.
+bool Rewind::step_back(Chip8& c8) {
+	if (Count == 0) { return false; }
+
+	Head = (Head + Ring.size() - 1) % Ring.size();
+	--Count;
+	const Entry& e = Ring[Head];
+
+	c8.load_state(Prev);
+
+	// Prev becomes the state as of the entry before this one.
+	const uint8_t* undo = e.Undo.data();
+	for (auto page : e.Changed) {
+		const size_t off = page * PageSize;
+		const size_t len = std::min(PageSize, Size - off);
+		std::copy_n(undo, len, &Prev[off]);
+		undo += len;
+	}
+	return true;
+}
@@ -0,0 +1,35 @@
+#ifndef _C8E_REWIND_HH_
+#define _C8E_REWIND_HH_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "chip8.hh"
+
+// Per-frame undo history. Each entry keeps the previous contents of only the
+// save state pages that changed since the entry before it, so a frame that
+// doesn't draw or store to Memory costs one page of registers.
+struct Rewind {
+	static constexpr size_t PageSize = Chip8::PageSize;
+
+	struct Entry {
+		std::vector<uint16_t> Changed;  // Pages in Undo, ascending
+		std::vector<uint8_t>  Undo;
+	};
+
+	std::vector<Entry> Ring;
+	size_t             Head{};   // Next slot to write
+	size_t             Count{};  // Entries held
+	Chip8::State       Prev{};   // State at the last push
+	Chip8::State       Scratch{};
+	size_t             Size{};  // Bytes of Prev in use
+
+	explicit Rewind(size_t frames = 60 * 60 * 5);
+
+	void push(const Chip8& c8);
+	bool step_back(Chip8& c8);
+	void clear() { Count = 0; }
+};
+#endif
@@ -0,0 +1,89 @@
+#include "rom.hh"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define C8E_MMAP
+#else
+#include <fstream>
+#endif
+
+#include "hash.hh"
+
+const char* describe(LoadError e) {
+	switch (e) {
+		case LoadError::None: return "ok";
+		case LoadError::Open: return "can't open file";
+		case LoadError::Empty: return "file is empty";
+		case LoadError::TooLarge: return "doesn't fit in memory above 0x200";
+	}
+	return "unknown error";
+}
+
+Rom& Rom::operator=(Rom&& o) noexcept {
+	if (this != &o) {
+		close();
+		Data = std::exchange(o.Data, nullptr);
+		Size = std::exchange(o.Size, 0);
+		Hash = std::exchange(o.Hash, 0);
+		Map  = std::exchange(o.Map, nullptr);
+		Copy = std::move(o.Copy);
+	}
+	return *this;
+}
+
+LoadError Rom::open(const char* filename, size_t limit) {
+	close();
+#ifdef C8E_MMAP
+	const int fd = ::open(filename, O_RDONLY);
+	if (fd < 0) { return LoadError::Open; }
+
+	struct stat st {};
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		::close(fd);
+		return LoadError::Open;
+	}
+	if (st.st_size == 0 || size_t(st.st_size) > limit) {
+		::close(fd);
+		return st.st_size == 0 ? LoadError::Empty : LoadError::TooLarge;
+	}
+
+	void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) { return LoadError::Open; }
+	Map  = p;
+	Data = static_cast<const uint8_t*>(p);
+	Size = st.st_size;
+#else
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) { return LoadError::Open; }
+
+	const std::streamoff size = file.tellg();
+	if (size <= 0 || size_t(size) > limit) {
+		return size == 0 ? LoadError::Empty : LoadError::TooLarge;
+	}
+	Copy.resize(size);
+	file.seekg(0);
+	if (!file.read(reinterpret_cast<char*>(Copy.data()), size)) {
+		Copy.clear();
+		return LoadError::Open;
+	}
+	Data = Copy.data();
+	Size = Copy.size();
+#endif
+	Hash = fnv1a(Data, Size);
+	return LoadError::None;
+}
+
+void Rom::close() {
+#ifdef C8E_MMAP
+	if (Map != nullptr) { munmap(Map, Size); }
+#endif
+	Map  = nullptr;
+	Data = nullptr;
+	Size = 0;
+	Hash = 0;
+	Copy.clear();
+}
@@ -0,0 +1,40 @@
+#ifndef _C8E_ROM_HH_
+#define _C8E_ROM_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+enum class LoadError { None, Open, Empty, TooLarge };
+
+const char* describe(LoadError e);
+
+// A ROM image mapped read-only from disk. Opening checks it fits in memory
+// above 0x200 (4 KB, or 64 KB for XO-CHIP) and hashes it; the pages are only
+// shared with the page cache, so one Rom can seed any number of machines
+// without extra copies.
+struct Rom {
+	static constexpr uint16_t Base      = 0x200;
+	static constexpr size_t   MaxSize   = 0x1000 - Base;
+	static constexpr size_t   MaxXOSize = 0x10000 - Base;
+
+	const uint8_t* Data{};
+	size_t         Size{};
+	uint64_t       Hash{};  // FNV-1a of the image
+
+	Rom() = default;
+	Rom(Rom&& o) noexcept { *this = std::move(o); }
+	Rom& operator=(Rom&& o) noexcept;
+	Rom(const Rom&)            = delete;
+	Rom& operator=(const Rom&) = delete;
+	~Rom() { close(); }
+
+	LoadError open(const char* filename, size_t limit = MaxSize);
+	void      close();
+
+private:
+	void*                Map{};
+	std::vector<uint8_t> Copy;  // Where mmap isn't available
+};
+#endif
@@ -0,0 +1,129 @@
+#include "scheduler.hh"
+
+#include <algorithm>
+
+#include "aot.hh"
+#include "audio.hh"
+#include "inputlog.hh"
+#include "jit.hh"
+
+namespace {
+// Don't try to catch up on more than this after a stall (window drag, etc.).
+constexpr Scheduler::Tick MaxLag{6};
+
+// Unthrottled mode runs until this much of a refresh has passed, leaving the
+// rest for the frontend to present.
+constexpr auto     TurboBudget = std::chrono::milliseconds(12);
+constexpr uint32_t TurboChunk  = 4096;
+}  // namespace
+
+void Scheduler::start() {
+	Last = Clock::now();
+	Lag  = Span::zero();
+	Frac = 0;
+	Owed = 0;
+	Busy = false;
+}
+
+// When the next timer period is due; frontends with nothing to show sleep
+// until then.
+Scheduler::Clock::time_point Scheduler::next_tick() const {
+	return Last + std::chrono::duration_cast<Clock::duration>(Tick{1} - Lag);
+}
+
+uint64_t Scheduler::run_cycles(Chip8& c8, uint64_t n) {
+	if (Replay == nullptr) { return run_span(c8, n); }
+
+	// Stop at each logged key change so it lands on the recorded cycle.
+	uint64_t ran = 0;
+	while (ran != n) {
+		Replay->apply(c8);
+		const uint64_t span =
+		    std::min(n - ran, Replay->NextCycle - c8.Cycles);
+		const uint64_t done = run_span(c8, span);
+		ran += done;
+		if (done != span) { break; }
+	}
+	return ran;
+}
+
+void Scheduler::tick(Chip8& c8) {
+	c8.tick_timers();
+	++Ticks;
+	if (Sound != nullptr) { Sound->push(c8); }
+}
+
+// Waits found along the way are skipped to the end of the span: nothing can
+// wake them before the next timer tick or key change, and spans end there.
+uint64_t Scheduler::run_span(Chip8& c8, uint64_t n) {
+	c8.Waiting = Wait::None;
+	uint64_t ran = n;
+	if (Translated != nullptr) {
+		ran = Translated->run(c8, n);
+	} else if (Recompiler != nullptr) {
+		ran = Recompiler->run(c8, n);
+	} else {
+		for (uint64_t i = 0; i != n; ++i) {
+			c8.emulate_cycle();
+			if (c8.Idle) { i += c8.idle(n - i - 1); }
+		}
+	}
+	Blocked = c8.Waiting;
+	return ran;
+}
+
+// One 60 Hz timer period worth of instructions, then a timer tick. The
+// remainder of Rate / TimerHz is carried so the long-run rate is exact. With a
+// limit the period may be left part-done; the next call finishes it.
+uint64_t Scheduler::step_tick(Chip8& c8, uint64_t limit) {
+	if (!Busy) {
+		Frac += Rate;
+		Owed = Frac / TimerHz;
+		Frac %= TimerHz;
+		Busy = true;
+	}
+
+	const uint64_t ran = run_cycles(c8, std::min(Owed, limit));
+	Owed -= ran;
+	if (Owed == 0) {
+		tick(c8);
+		Busy = false;
+	}
+	return ran;
+}
+
+// Runs whatever is owed since the last call. Returns the instructions run.
+// Turbo runs whole periods for the same budget as unthrottled mode, so the
+// timers keep in step with the CPU and the game just plays faster; the wall
+// clock is left behind rather than caught up on afterwards.
+uint64_t Scheduler::run_frame(Chip8& c8) {
+	const auto now = Clock::now();
+	Lag += now - Last;
+	Last = now;
+	if (Lag > MaxLag) { Lag = MaxLag; }
+
+	uint64_t ran = 0;
+	if (Turbo && Rate != 0) {
+		const auto deadline = now + TurboBudget;
+		do {
+			ran += step_tick(c8);
+		} while (Clock::now() < deadline && Blocked != Wait::Key &&
+		         Blocked != Wait::Halt);
+
+		Last = Clock::now();
+		Lag  = Span::zero();
+		return ran;
+	}
+	if (Rate == 0) {
+		const auto deadline = now + TurboBudget;
+		do {
+			ran += run_cycles(c8, TurboChunk);
+		} while (Clock::now() < deadline && Blocked == Wait::None);
+
+		for (; Lag >= Tick{1}; Lag -= Tick{1}) { tick(c8); }
+		return ran;
+	}
+
+	for (; Lag >= Tick{1}; Lag -= Tick{1}) { ran += step_tick(c8); }
+	return ran;
+}
@@ -0,0 +1,49 @@
+#ifndef _C8E_SCHEDULER_HH_
+#define _C8E_SCHEDULER_HH_
+
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
+#include "chip8.hh"
+
+struct Aot;
+struct Audio;
+struct InputPlayer;
+struct Jit;
+
+// Paces the CPU at a fixed instruction rate independent of how often the
+// frontend presents. DT/ST tick at exactly 60 Hz off the wall clock.
+struct Scheduler {
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr uint32_t TimerHz = 60;
+	using Tick = std::chrono::duration<int64_t, std::ratio<1, TimerHz>>;
+	using Span = std::common_type_t<Clock::duration, Tick>;  // Exact in both
+
+	uint32_t     Rate{700};     // Instructions per second, 0 = unthrottled
+	Jit*         Recompiler{};  // Runs blocks natively when set
+	Aot*         Translated{};  // Runs ahead-of-time blocks when set, first
+	InputPlayer* Replay{};      // Feeds recorded keys when set
+	Audio*       Sound{};       // Gets the sound state after every timer tick
+	bool         Turbo{};       // Run timer periods back to back, unpaced
+	uint64_t     Ticks{};       // Timer periods completed, for speed readouts
+	Wait         Blocked{};     // What the last run ended up waiting on
+
+	Clock::time_point Last{};
+	Span              Lag{};
+	uint32_t          Frac{};   // Rate remainder carried between ticks
+	uint64_t          Owed{};   // Cycles left before the next timer tick
+	bool              Busy{};   // Part way through a tick period
+
+	void     start();
+	Clock::time_point next_tick() const;
+	uint64_t run_frame(Chip8& c8);
+	uint64_t step_tick(Chip8& c8, uint64_t limit = UINT64_MAX);
+	uint64_t run_cycles(Chip8& c8, uint64_t n);
+
+private:
+	uint64_t run_span(Chip8& c8, uint64_t n);
+	void     tick(Chip8& c8);
+};
+#endif
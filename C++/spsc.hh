@@ -0,0 +1,77 @@
+#ifndef _C8E_SPSC_HH_
+#define _C8E_SPSC_HH_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Handoffs between exactly one producer thread and one consumer thread.
+// Neither side ever waits on the other.
+
+// Queue of values. The producer only writes Head and the consumer only
+// writes Tail.
+template <typename T, size_t N>
+struct SpscRing {
+	static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+	std::array<T, N> Slots{};
+	alignas(64) std::atomic<size_t> Head{};  // Next slot to write
+	alignas(64) std::atomic<size_t> Tail{};  // Next slot to read
+
+	// False, dropping v, when full.
+	bool push(const T& v) {
+		const size_t head = Head.load(std::memory_order_relaxed);
+		if (head - Tail.load(std::memory_order_acquire) == N) { return false; }
+		Slots[head % N] = v;
+		Head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& v) {
+		const size_t tail = Tail.load(std::memory_order_relaxed);
+		if (Head.load(std::memory_order_acquire) == tail) { return false; }
+		v = Slots[tail % N];
+		Tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t size() const {
+		return Head.load(std::memory_order_acquire) -
+		       Tail.load(std::memory_order_acquire);
+	}
+};
+
+// Latest value only. The producer fills back() and publishes it; the
+// consumer picks up the newest published slot, skipping any it missed.
+// Three slots, so each side always has one of its own.
+template <typename T>
+struct TripleBuffer {
+	T&       back() { return Slots[Back]; }
+	const T& front() const { return Slots[Front]; }
+
+	void publish() {
+		Back = Middle.exchange(Back | Fresh, std::memory_order_acq_rel) &
+		       Index;
+	}
+
+	// True, with front() now the newest value, if one was published since the
+	// last call.
+	bool update() {
+		if ((Middle.load(std::memory_order_relaxed) & Fresh) == 0) {
+			return false;
+		}
+		Front = Middle.exchange(Front, std::memory_order_acq_rel) & Index;
+		return true;
+	}
+
+private:
+	static constexpr uint8_t Index = 3;
+	static constexpr uint8_t Fresh = 4;  // Middle holds an unread value
+
+	std::array<T, 3> Slots{};
+	alignas(64) std::atomic<uint8_t> Middle{1};
+	alignas(64) uint8_t Back{0};   // Producer's own
+	alignas(64) uint8_t Front{2};  // Consumer's own
+};
+#endif
@@ -0,0 +1,78 @@
+#include "trace.hh"
+
+#include <algorithm>
+#include <fstream>
+
+namespace {
+constexpr std::array<char, 4> Magic{'C', '8', 'T', 'R'};
+
+template <typename T>
+void put(std::ostream& os, T v) {
+	for (size_t i = 0; i != sizeof(T); ++i) { os.put((v >> (8 * i)) & 0xFF); }
+}
+
+template <typename T>
+bool get(std::istream& is, T& v) {
+	v = 0;
+	for (size_t i = 0; i != sizeof(T); ++i) {
+		const int c = is.get();
+		if (c == EOF) { return false; }
+		v |= T(c) << (8 * i);
+	}
+	return true;
+}
+}  // namespace
+
+// Capacity is rounded up to a power of two so the ring index is a mask.
+Tracer::Tracer(size_t capacity) {
+	size_t n = 1;
+	while (n < capacity) { n <<= 1; }
+	Ring.resize(n);
+}
+
+std::vector<Tracer::Entry> Tracer::entries() const {
+	const size_t       kept = std::min<uint64_t>(Total, Ring.size());
+	std::vector<Entry> out;
+	out.reserve(kept);
+	for (uint64_t i = Total - kept; i != Total; ++i) {
+		out.push_back(Ring[i & (Ring.size() - 1)]);
+	}
+	return out;
+}
+
+bool Tracer::save(const char* filename) const {
+	const auto    list = entries();
+	std::ofstream file(filename, std::ios::binary);
+	file.write(Magic.data(), Magic.size());
+	put(file, Version);
+	put(file, Total);
+	put(file, uint32_t(list.size()));
+	for (const auto& e : list) {
+		put(file, e.PC), put(file, e.OC), put(file, e.Changed), put(file, e.I);
+		put(file, e.VX), put(file, e.VF), put(file, e.DT), put(file, e.SP);
+	}
+	return file.good();
+}
+
+bool Tracer::load(const char* filename, std::vector<Entry>& entries,
+                  uint64_t& total) {
+	std::ifstream       file(filename, std::ios::binary);
+	std::array<char, 4> magic{};
+	uint8_t             version = 0;
+	uint32_t            count   = 0;
+	file.read(magic.data(), magic.size());
+	if (magic != Magic || !get(file, version) || version != Version ||
+	    !get(file, total) || !get(file, count)) {
+		return false;
+	}
+
+	entries.resize(count);
+	for (auto& e : entries) {
+		if (!get(file, e.PC) || !get(file, e.OC) || !get(file, e.Changed) ||
+		    !get(file, e.I) || !get(file, e.VX) || !get(file, e.VF) ||
+		    !get(file, e.DT) || !get(file, e.SP)) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,64 @@
+#ifndef _C8E_TRACE_HH_
+#define _C8E_TRACE_HH_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "chip8.hh"
+
+// Fixed-size ring of the most recent instructions, recorded by
+// Chip8::emulate_cycle while Chip8::Trace is set. Each step costs a 12-byte
+// store and no formatting; C8E-tracedump turns a saved trace into text.
+//
+// File layout: "C8TR", version, total steps recorded (u64), entries kept
+// (u32), then the entries oldest first. Multi-byte fields are little-endian.
+struct Tracer {
+	static constexpr uint8_t Version = 1;
+
+	// State after the step. VX and VF are the registers an instruction
+	// normally writes; Changed says which V registers actually changed.
+	struct Entry {
+		uint16_t PC;
+		uint16_t OC;
+		uint16_t Changed;  // Bit r set when Vr changed
+		uint16_t I;
+		uint8_t  VX;
+		uint8_t  VF;
+		uint8_t  DT;
+		uint8_t  SP;
+	};
+	static_assert(sizeof(Entry) == 12);
+
+	std::vector<Entry> Ring;
+	uint64_t           Total{};  // Steps recorded; Ring holds the last ones
+
+	explicit Tracer(size_t capacity = size_t{1} << 20);
+
+	void record(const Chip8& c8, uint16_t pc,
+	            const std::array<uint8_t, 16>& before) {
+#if defined(__SSE2__)
+		const __m128i now = _mm_loadu_si128((const __m128i*)c8.V.data());
+		const __m128i old = _mm_loadu_si128((const __m128i*)before.data());
+		const uint16_t changed = ~_mm_movemask_epi8(_mm_cmpeq_epi8(now, old));
+#else
+		uint16_t changed = 0;
+		for (uint8_t r = 0; r != 16; ++r) {
+			changed |= (c8.V[r] != before[r]) << r;
+		}
+#endif
+		const uint8_t x = c8.OC >> 8 & 0xF;
+		Ring[Total++ & (Ring.size() - 1)] = {
+		    pc, c8.OC, changed, c8.I, c8.V[x], c8.V[0xF], c8.DT, c8.SP};
+	}
+
+	std::vector<Entry> entries() const;  // Oldest first
+	bool               save(const char* filename) const;
+	static bool load(const char* filename, std::vector<Entry>& entries,
+	                 uint64_t& total);
+};
+#endif
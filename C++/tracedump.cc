@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#include "disasm.hh"
+#include "trace.hh"
+
+// Formats a trace saved by C8E -T or C8E-headless -T, one line per step:
+// step number, PC, opcode, mnemonic, then what the step changed. I, DT and
+// SP changes are found by diffing against the previous entry, so the first
+// line shows them in full.
+
+namespace {
+void usage(const char* prog) {
+	std::cerr << "usage: " << prog
+	          << " [-n last] [-m chip8|schip|xochip] trace\n";
+}
+
+void changes(std::ostream& os, const Tracer::Entry& e,
+             const Tracer::Entry* prev) {
+	const uint8_t x = e.OC >> 8 & 0xF;
+	for (uint8_t r = 0; r != 16; ++r) {
+		if ((e.Changed >> r & 1) == 0) { continue; }
+		os << " V" << +r;
+		if (r == x) {
+			os << "=" << std::setw(2) << +e.VX;
+		} else if (r == 0xF) {
+			os << "=" << std::setw(2) << +e.VF;
+		}
+	}
+	if (prev == nullptr || e.I != prev->I) {
+		os << " I=" << std::setw(3) << e.I;
+	}
+	if (prev == nullptr || e.DT != prev->DT) {
+		os << " DT=" << std::setw(2) << +e.DT;
+	}
+	if (prev == nullptr || e.SP != prev->SP) { os << " SP=" << +e.SP; }
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+	const char* path = nullptr;
+	uint64_t    last = UINT64_MAX;
+	Mode        mode = Mode::Chip8;  // Only affects the mnemonics
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		if (arg == "-n" && i + 1 < argc) {
+			last = std::strtoull(argv[++i], nullptr, 10);
+		} else if (arg == "-m" && i + 1 < argc &&
+		           parse_mode(argv[i + 1], mode)) {
+			++i;
+		} else if (arg[0] == '-') {
+			usage(argv[0]);
+			return -1;
+		} else {
+			path = argv[i];
+		}
+	}
+	if (path == nullptr) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	std::vector<Tracer::Entry> entries;
+	uint64_t                   total = 0;
+	if (!Tracer::load(path, entries, total)) {
+		std::cerr << "can't read trace " << path << "\n";
+		return -1;
+	}
+
+	const size_t   shown = std::min<uint64_t>(last, entries.size());
+	const size_t   start = entries.size() - shown;
+	const uint64_t first = total - entries.size();  // Step of entries[0]
+
+	for (size_t i = start; i != entries.size(); ++i) {
+		const auto&        e = entries[i];
+		std::ostringstream delta;
+		delta << std::hex << std::uppercase << std::setfill('0');
+		changes(delta, e, i == start ? nullptr : &entries[i - 1]);
+
+		std::cout << std::setw(12) << first + i << "  " << std::hex
+		          << std::uppercase << std::setfill('0') << std::setw(3)
+		          << e.PC << "  " << std::setw(4) << e.OC << "  "
+		          << std::setfill(' ') << std::left
+		          << std::setw(delta.tellp() > 0 ? 16 : 0)
+		          << disasm(e.OC, mode) << std::right << std::dec
+		          << delta.str() << "\n";
+	}
+	return 0;
+}
@@ -0,0 +1,197 @@
+#include "video.hh"
+
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+uint32_t* fill(uint32_t* p, uint32_t color, uint32_t n) {
+#if defined(__SSE2__)
+	const __m128i v = _mm_set1_epi32(color);
+	for (; n >= 4; n -= 4, p += 4) {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+	}
+#endif
+	for (; n != 0; --n) { *p++ = color; }
+	return p;
+}
+
+void put_be32(std::vector<uint8_t>& out, uint32_t v) {
+	for (int shift = 24; shift >= 0; shift -= 8) { out.push_back(v >> shift); }
+}
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+	static const std::array<uint32_t, 256> table = [] {
+		std::array<uint32_t, 256> t{};
+		for (uint32_t i = 0; i != 256; ++i) {
+			uint32_t c = i;
+			for (int k = 0; k != 8; ++k) {
+				c = c & 1 ? 0xEDB88320 ^ c >> 1 : c >> 1;
+			}
+			t[i] = c;
+		}
+		return t;
+	}();
+	crc = ~crc;
+	for (size_t i = 0; i != size; ++i) {
+		crc = table[(crc ^ data[i]) & 0xFF] ^ crc >> 8;
+	}
+	return ~crc;
+}
+
+uint32_t adler32(const uint8_t* data, size_t size) {
+	uint32_t a = 1;
+	uint32_t b = 0;
+	while (size != 0) {
+		// 5552 bytes is the most that can't overflow b before the modulo.
+		const size_t n = std::min<size_t>(size, 5552);
+		for (size_t i = 0; i != n; ++i) {
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += n;
+		size -= n;
+	}
+	return b << 16 | a;
+}
+
+// Length, type, data, CRC of type and data.
+void write_chunk(std::ofstream& file, const char* type,
+                 const std::vector<uint8_t>& data) {
+	std::vector<uint8_t> body(type, type + 4);
+	body.insert(body.end(), data.begin(), data.end());
+
+	std::vector<uint8_t> head;
+	put_be32(head, data.size());
+	std::vector<uint8_t> tail;
+	put_be32(tail, crc32(0, body.data(), body.size()));
+
+	file.write(reinterpret_cast<const char*>(head.data()), head.size());
+	file.write(reinterpret_cast<const char*>(body.data()), body.size());
+	file.write(reinterpret_cast<const char*>(tail.data()), tail.size());
+}
+
+// R, G, B, A; the byte order of the packed value written big-endian.
+std::vector<uint8_t> rgba_bytes(const Image& image, bool rowFilters) {
+	std::vector<uint8_t> bytes;
+	bytes.reserve(image.Pixels.size() * 4 + image.Height);
+	for (uint32_t y = 0; y != image.Height; ++y) {
+		if (rowFilters) { bytes.push_back(0); }  // Filter: none
+		for (uint32_t x = 0; x != image.Width; ++x) {
+			put_be32(bytes, image.Pixels[y * image.Width + x]);
+		}
+	}
+	return bytes;
+}
+}  // namespace
+
+void render_rows(const std::array<Chip8::Plane, 2>& display, bool hires,
+                 uint32_t scale, const Palette& palette, int top, int bottom,
+                 uint32_t* out, size_t pitch) {
+	const size_t rowPixels = (hires ? 128 : 64) * scale;
+	for (int y = top; y <= bottom; ++y) {
+		uint32_t* const row = out + (y - top) * scale * pitch;
+
+		// Widen the first output row word by word, then copy it down.
+		uint32_t* p = row;
+		for (int half = 0; half != (hires ? 2 : 1); ++half) {
+			const uint64_t a = display[0][half * 64 + y];
+			const uint64_t b = display[1][half * 64 + y];
+			for (int bit = 63; bit >= 0; --bit) {
+				const uint8_t color = ((a >> bit) & 1) | ((b >> bit) & 1) << 1;
+				p = fill(p, palette[color], scale);
+			}
+		}
+		for (uint32_t r = 1; r != scale; ++r) {
+			std::memcpy(row + r * pitch, row, rowPixels * sizeof(uint32_t));
+		}
+	}
+}
+
+void render(const std::array<Chip8::Plane, 2>& display, bool hires,
+            uint32_t scale, Image& image, const Palette& palette) {
+	const int height = hires ? 64 : 32;
+	image.Width      = (hires ? 128 : 64) * scale;
+	image.Height     = height * scale;
+	image.Pixels.resize(size_t{image.Width} * image.Height);
+	render_rows(display, hires, scale, palette, 0, height - 1,
+	            image.Pixels.data(), image.Width);
+}
+
+bool write_png(const char* filename, const Image& image) {
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) { return false; }
+
+	constexpr std::array<uint8_t, 8> Signature{0x89, 'P',  'N', 'G',
+	                                           '\r', '\n', 0x1A, '\n'};
+	file.write(reinterpret_cast<const char*>(Signature.data()),
+	           Signature.size());
+
+	std::vector<uint8_t> header;
+	put_be32(header, image.Width);
+	put_be32(header, image.Height);
+	header.insert(header.end(), {8, 6, 0, 0, 0});  // 8-bit RGBA
+	write_chunk(file, "IHDR", header);
+
+	// zlib stream of stored deflate blocks, 65535 bytes at most each.
+	const std::vector<uint8_t> raw = rgba_bytes(image, true);
+	std::vector<uint8_t>       z{0x78, 0x01};
+	size_t                     at = 0;
+	do {
+		const size_t n    = std::min<size_t>(raw.size() - at, 65535);
+		const bool   last = at + n == raw.size();
+		z.insert(z.end(), {uint8_t(last), uint8_t(n), uint8_t(n >> 8),
+		                   uint8_t(~n), uint8_t(~n >> 8)});
+		z.insert(z.end(), raw.begin() + at, raw.begin() + at + n);
+		at += n;
+	} while (at != raw.size());
+	put_be32(z, adler32(raw.data(), raw.size()));
+	write_chunk(file, "IDAT", z);
+
+	write_chunk(file, "IEND", {});
+	return bool(file);
+}
+
+bool write_raw(const char* filename, const Image& image) {
+	std::ofstream              file(filename, std::ios::binary);
+	const std::vector<uint8_t> bytes = rgba_bytes(image, false);
+	file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+	return bool(file);
+}
+
+bool Y4mWriter::open(const char* filename, uint32_t width, uint32_t height) {
+	Out.open(filename, std::ios::binary);
+	Width  = width;
+	Height = height;
+	Out << "YUV4MPEG2 W" << width << " H" << height << " F60:1 Ip A1:1 C444\n";
+	return bool(Out);
+}
+
+bool Y4mWriter::write(const Image& image) {
+	if (image.Width != Width || image.Height != Height) { return false; }
+
+	// Studio-swing BT.601 in 8-bit fixed point.
+	const size_t n = image.Pixels.size();
+	Planes.resize(n * 3);
+	for (size_t i = 0; i != n; ++i) {
+		const uint32_t c  = image.Pixels[i];
+		const int      r  = c >> 24;
+		const int      g  = (c >> 16) & 0xFF;
+		const int      b  = (c >> 8) & 0xFF;
+		Planes[i]         = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+		Planes[n + i]     = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+		Planes[2 * n + i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+	}
+	Out << "FRAME\n";
+	Out.write(reinterpret_cast<const char*>(Planes.data()), Planes.size());
+	return bool(Out);
+}
+
+bool Y4mWriter::close() {
+	Out.close();
+	return bool(Out);
+}
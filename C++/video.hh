@@ -0,0 +1,61 @@
+#ifndef _C8E_VIDEO_HH_
+#define _C8E_VIDEO_HH_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+#include "chip8.hh"
+
+// Display to pixels: a palette lookup into RGBA8888 (0xRRGGBBAA, what SDL
+// calls SDL_PIXELFORMAT_RGBA8888) and integer upscaling on the CPU, plus the
+// image and video files headless runs dump.
+
+using Palette = std::array<uint32_t, 4>;  // By color index, see Chip8::pixel
+
+// Black and white, then XO-CHIP's second plane in orange and both planes in
+// dark brown.
+constexpr Palette DefaultPalette{0x000000FF, 0xFFFFFFFF, 0xFF6600FF,
+                                 0x662200FF};
+
+struct Image {
+	uint32_t              Width{};
+	uint32_t              Height{};
+	std::vector<uint32_t> Pixels;  // Row-major, RGBA8888
+};
+
+// Draws display rows top to bottom, each pixel as a scale x scale block, into
+// out, which is the first output row of top and pitch pixels wide.
+void render_rows(const std::array<Chip8::Plane, 2>& display, bool hires,
+                 uint32_t scale, const Palette& palette, int top, int bottom,
+                 uint32_t* out, size_t pitch);
+
+// The whole display at scale, resizing image to fit.
+void render(const std::array<Chip8::Plane, 2>& display, bool hires,
+            uint32_t scale, Image& image,
+            const Palette& palette = DefaultPalette);
+
+// 8-bit RGBA PNG. The image data is stored, not compressed: it is written
+// for regression diffs by the thousand, where speed matters more than size.
+bool write_png(const char* filename, const Image& image);
+
+// Bare R, G, B, A bytes, row by row.
+bool write_raw(const char* filename, const Image& image);
+
+// YUV4MPEG2 stream at 60 fps, 4:4:4 BT.601. Every frame must have the size
+// given to open().
+struct Y4mWriter {
+	std::ofstream Out;
+	uint32_t      Width{};
+	uint32_t      Height{};
+
+	bool open(const char* filename, uint32_t width, uint32_t height);
+	bool write(const Image& image);
+	bool close();  // Flushes; false if anything failed to reach the file
+
+private:
+	std::vector<uint8_t> Planes;  // Y, U and V of one frame
+};
+#endif